@@ -28,6 +28,8 @@
 #   define IN
 #   define OUT
 #   define INOUT
+#   define POOL_CLASSES 0x10    // must match the library
+#   define REGISTRY_BUCKETS 0x100   // must match the library
 //#   define SUPPORT_PE32PLUS 0   // set to 1 if using PEel32Plus.lib
                                 //        0 if using PEel32.lib
 #pragma endregion
@@ -78,14 +80,32 @@
         typedef THUNK_DATA32             THUNK_DATA;
 #endif
         typedef IMAGE_IMPORT_BY_NAME	 IMPORT_NAME;
+        typedef IMAGE_TLS_DIRECTORY32    TLS_DIRECTORY32;
+        typedef IMAGE_TLS_DIRECTORY64    TLS_DIRECTORY64;
+#if SUPPORT_PE32PLUS
+        typedef TLS_DIRECTORY64          TLS_DIRECTORY;
+#else
+        typedef TLS_DIRECTORY32          TLS_DIRECTORY;
+#endif
+        typedef IMAGE_BOUND_IMPORT_DESCRIPTOR BOUND_IMPORT_DESCRIPTOR;
+        typedef IMAGE_BOUND_FORWARDER_REF BOUND_FORWARDER_REF;
         typedef IMAGE_EXPORT_DIRECTORY   EXPORT_DIRECTORY;
         typedef IMAGE_DEBUG_DIRECTORY    DEBUG_DIRECTORY;
         typedef IMAGE_RESOURCE_DIRECTORY RESOURCE_DIRECTORY;
         typedef IMAGE_RESOURCE_DIRECTORY_ENTRY RESOURCE_DIRECTORY_ENTRY;
         typedef IMAGE_RESOURCE_DATA_ENTRY RESOURCE_DATA_ENTRY;
+        typedef IMAGE_RESOURCE_DIR_STRING_U RESOURCE_DIR_STRING;
         
         #define OPT_HDR_MAGIC32 IMAGE_NT_OPTIONAL_HDR32_MAGIC
         #define OPT_HDR_MAGIC64 IMAGE_NT_OPTIONAL_HDR64_MAGIC
+        #define DELAY_ATTRIBUTE_RVA 0x01     // dlattrRva, delay import descriptor holds rvas
+        #define GUARD_CF_INSTRUMENTED 0x100          // IMAGE_GUARD_CF_INSTRUMENTED, GuardFlags
+        #define GUARD_CF_STRIDE_MASK 0xF0000000      // IMAGE_GUARD_CF_FUNCTION_TABLE_SIZE_MASK, extra bytes per GuardCFFunctionTable entry
+        #define GUARD_CF_STRIDE_SHIFT 28
+        #define GUARD_FLAG_FID_SUPPRESSED 0x01       // first extra byte of a GuardCFFunctionTable entry
+        #define GUARD_FLAG_EXPORT_SUPPRESSED 0x02
+        #define CODEVIEW_SIGNATURE_RSDS 0x53445352   // 'RSDS', pdb 7.0 CodeView record
+        #define CODEVIEW_SIGNATURE_NB10 0x3031424e   // 'NB10', pdb 2.0 CodeView record
 #if SUPPORT_PE32PLUS
         #define OPT_HDR_MAGIC OPT_HDR_MAGIC64
 #else
@@ -107,7 +127,11 @@
             PTR     Relocated : 1,	// relocations are resolved
                     Imported  : 1,	// imports are resolved
                     Protected : 1,	// image has proper protection
-                    Attached  : 1;	// points to an externally allocated image
+                    Attached  : 1,	// points to an externally allocated image
+                    Mapped    : 1,	// backed by a view of hMapping, released with UnmapViewOfFile
+                    Tracked   : 1,	// PlWriteRva/PlWritePa record file ranges in pDirty
+                    Pooled    : 1,	// buffer came from pContext's pool, goes back there when freed
+                    Image     : 1;	// image aligned, sections sit at their rvas and cbBuffer is MaxRva
         } PE_FLAGS;
 
         typedef struct _CODECAVE_LINKED_LIST32 {
@@ -124,12 +148,28 @@
             char  *Name,          // ptr to function name (NULL if by ordinal)
                   *Ordinal;       // ptr to DWORD ordinal number (NULL if by name)
             PTR32 *dwItemPtr;     // ptr to IAT entry
+            WORD   Hint;          // likely index into exporter's AddressOfNames (0 if by ordinal)
             void  *Flink;
         } IMPORT_ITEM;       // forward linked list of imports
 
+        typedef struct _DELAY_IMPORT_DESCRIPTOR {
+            DWORD   Attributes,             // DELAY_ATTRIBUTE_RVA if the fields below are rvas, vas otherwise
+                    DllNameRva,
+                    ModuleHandleRva,
+                    ImportAddressTableRva,
+                    ImportNameTableRva,
+                    BoundImportAddressTableRva,
+                    UnloadInformationTableRva,
+                    TimeDateStamp;
+        } DELAY_IMPORT_DESCRIPTOR;    // IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT entry, sdks before win8 don't have it
+
         typedef struct _IMPORT_LIBRARY_FLIST {
             char          *Library; // ptr to char* that hold library name
             IMPORT_ITEM   *iiImportList;
+            THUNK_DATA    *ptdNames,    // ILT (OriginalFirstThunk), FirstThunk if the linker left it out
+                          *ptdIat;      // IAT (FirstThunk), holds addresses once bound or loaded
+            DWORD          BoundTimeDateStamp;      // TimeDateStamp of library the IAT was bound against (0 if not bound)
+            DELAY_IMPORT_DESCRIPTOR *pDelayDesc;    // descriptor if delay loaded (NULL otherwise)
             void          *Flink;
         } IMPORT_LIBRARY;
 
@@ -141,14 +181,71 @@
         } EXPORT_LIST;
 
         typedef struct _RESOURCE_ITEM_FLIST {
-            PTR    dwType;
-            char  *Name;
-            PTR    wId; // only use lower WORD
-            size_t cbSize;
-            void  *pData,
-                  *Flink;
+            PTR                  dwType;    // type id (0 if named)
+            RESOURCE_DIR_STRING *TypeName;  // ptr to counted unicode type name (NULL if by id)
+            RESOURCE_DIR_STRING *Name;      // ptr to counted unicode name (NULL if by id)
+            PTR                  wId;       // only use lower WORD
+            PTR                  wLang;     // only use lower WORD
+            DWORD                dwCodePage;
+            size_t               cbSize;
+            void                *pData,     // ptr into image, not a copy
+                                *Flink;
         } RESOURCE_LIST;
+
+        typedef struct _DIRTY_RANGE_FLIST {
+            PTR     Offset,     // file offset
+                    cbSize;
+            void   *Flink;
+        } DIRTY_RANGE;      // sorted, ranges never overlap or touch
+
+        typedef struct _COPY_RANGE {
+            PTR     Offset;     // offset into destination buffer
+            size_t  cbSize;
+        } COPY_RANGE;       // part of a buffer a conversion wrote to
+
+        typedef struct _OVERLAY_VIEW {
+            PTR     Offset;     // file offset of overlay (PlMaxPa)
+            size_t  cbSize;     // cb of overlay (can be 0)
+            void   *pData;      // ptr into backing buffer, not a copy (NULL if cbSize is 0)
+            PTR64   qwHash;     // PlHashData of overlay
+        } OVERLAY_VIEW;     // data appended after the last section
         
+        typedef struct _POOL_BUFFER_FLIST {
+            void   *pBuffer;    // reserves its whole size class
+            size_t  cbCommitted;// committed from pBuffer on, the rest is only reserved
+            void   *Flink;
+        } POOL_BUFFER;
+
+        typedef struct _MODULE_ENTRY_FLIST {
+            char       *Name;           // lowercase module name (owned)
+            PTR64       qwNameHash;
+            struct _VIRTUAL_PE_MODULE32 *vm;
+            PTR         Base;           // vm->pBaseAddr
+            size_t      cbImage;        // SizeOfImage
+            DWORD       cRefs;
+            void       *NameFlink,      // next entry in same name bucket
+                       *BaseFlink;      // next entry in same base bucket
+        } MODULE_ENTRY;
+
+        typedef struct _MODULE_REGISTRY {
+            MODULE_ENTRY  *pByName[REGISTRY_BUCKETS],   // buckets hashed on lowercase name
+                          *pByBase[REGISTRY_BUCKETS];   // buckets hashed on base (allocation granularity)
+            MODULE_ENTRY **ppRanges;        // sorted by Base, image ranges never overlap
+            size_t         cModules,
+                           cMaxModules;     // capacity of ppRanges
+        } MODULE_REGISTRY; // loaded modules by name, base and address
+
+        typedef struct _PEEL_CONTEXT {
+            CRITICAL_SECTION csLock;
+            POOL_BUFFER     *pPool[POOL_CLASSES];   // free buffers, class n holds 0x10000 << n bytes
+            size_t           cbPooled,              // cb of buffers sitting in pPool
+                             cbPoolMax,             // pool releases buffers beyond this
+                             cbLargePage;           // large page size once PlEnableLargePages succeeds, 0 otherwise
+            struct _IMAGE_TEMPLATE_FLIST *pTemplates;   // forward-linked list of templates (PlGetTemplate)
+            struct _BIND_MODULE_FLIST    *pBindCache;   // forward-linked list of dependencies (PlBindImports)
+            MODULE_REGISTRY  Registry;              // modules registered with PlRegisterModule
+        } PEEL_CONTEXT;    // state shared by everything loaded through it
+
         typedef struct _RAW_PE {
             DOS_HEADER		  *pDosHdr;
             DOS_STUB 		  *pDosStub;
@@ -160,12 +257,17 @@
             SECTION_HEADER   **ppSecHdr;		    // array pointing to section headers
             void		     **ppSectionData;       // array pointing to section data
             PE_FLAGS		   LoadStatus;
+            size_t             cbBuffer;            // cb of backing buffer (0 if unknown)
+            HANDLE             hFile,               // file opened by PlOpenFile (NULL otherwise)
+                               hMapping;            // section backing pDosHdr if LoadStatus.Mapped
 // essentials (pointers only)
 // the following allocate memory and, however are only used when their respective functions are called
             CODECAVE_LIST     *pCaveData;	    // forward-linked list containing codecaves
             IMPORT_LIBRARY    *pImport;              // forward-linked list of imports
             EXPORT_LIST       *pExport;              // forward-linked list of exports
             RESOURCE_LIST     *pResource;              // forward-linked list of resources
+            DIRTY_RANGE       *pDirty;                 // forward-linked list of written file ranges (PlTrackDirty)
+            PEEL_CONTEXT      *pContext;               // optional, set after attaching, copied by conversions
         } RAW_PE;	// wraps PE file
 
 
@@ -181,6 +283,223 @@
            uint16_t Offset	: 12,
                     Type	: 4;
         } RELOC_ITEM;
+
+        typedef struct _RESOURCE_ITERATOR {
+            const RAW_PE             *rpe;
+            RESOURCE_DIRECTORY       *prdRoot;      // start of resource directory
+            PTR                       cbRoot;       // cb of resource directory
+            RESOURCE_DIRECTORY_ENTRY *prdeLevel[3]; // next entry at type, name and language level
+            DWORD                     dwLeft[3];    // entries left at each level (named + id can exceed a WORD)
+            int                       iDepth;       // current level (-1 when done)
+        } RESOURCE_ITERATOR;   // walks resource tree in place, no allocation
+
+        typedef struct _VERSION_INFO {
+            VS_FIXEDFILEINFO *pFixedInfo;       // NULL if missing or signature is wrong
+            WORD              wLang,            // translation of string table below
+                              wCodePage;
+            const WCHAR      *CompanyName,      // ptrs into image, NULL if missing
+                             *FileDescription,
+                             *FileVersion,
+                             *InternalName,
+                             *LegalCopyright,
+                             *OriginalFilename,
+                             *ProductName,
+                             *ProductVersion;
+            const void       *pStringTable;     // first StringTable block, for PlQueryVersionString
+            size_t            cbStringTable;
+        } VERSION_INFO;    // VS_VERSIONINFO parsed in place
+
+        typedef struct _IMAGE_SNAPSHOT {
+            VIRTUAL_MODULE   *vm;
+            void             *pBaseline;        // copy of image when snapshot was taken
+            size_t            cbImage;
+            PE_FLAGS          LoadStatus;       // flags when snapshot was taken
+            BOOL              bWriteWatch;      // image tracks its own writes (MEM_WRITE_WATCH)
+            void            **ppDirty;          // GetWriteWatch output, one entry per page
+            size_t            cPages,
+                              cRestored;        // pages copied back by last PlRestoreImage
+        } IMAGE_SNAPSHOT;  // baseline of an image to reset it to
+
+        typedef struct _PROTECT_RUN {
+            PTR     Rva,        // page aligned
+                    cbSize;     // page aligned
+            DWORD   dwProtect;
+        } PROTECT_RUN;
+
+        typedef struct _PROTECT_PLAN {
+            PROTECT_RUN *pRuns;     // sorted, adjacent runs never share protection
+            size_t       cRuns,     // VirtualProtect calls needed
+                         cSaved;    // calls saved over one per header/section
+        } PROTECT_PLAN;    // page protection of an image in as few calls as possible
+
+        typedef struct _IMAGE_TEMPLATE_FLIST {
+            PTR64           qwKey;          // PlGetFileIdentity of file
+            DWORD           TimeDateStamp,  // of file, to match without waiting for vm
+                            SizeOfImage;
+            HANDLE          hBuilt;         // manual-reset event, set once building is done
+            volatile BOOL   bBuilding;      // vm is still being built, wait on hBuilt
+            LOGICAL         lBuild;         // result of building
+            size_t          cWaiters;       // threads waiting on hBuilt, the last one frees a failed template
+            VIRTUAL_MODULE  vm;             // shared (PlShareImage) image, never relocated
+            PTR             Base;           // base vm's contents are correct for (ImageBase)
+            DWORD          *pFixups32,      // rvas of HIGHLOW relocations
+                           *pFixups64;      // rvas of DIR64 relocations
+            size_t          cFixups32,
+                            cFixups64;
+            void           *Flink;
+        } IMAGE_TEMPLATE;  // prepared image instances are stamped out of
+
+        typedef struct _EXPORT_NAME {
+            const char *Name;
+            WORD        wIndex;         // index into AddressOfFunctions
+        } EXPORT_NAME;
+
+        typedef struct _BIND_MODULE_FLIST {
+            char        *Library;       // lowercase file name (owned)
+            RAW_PE       PE;            // dependency opened with PlOpenFile
+            PTR          Base;          // base imports are bound against (ImageBase)
+            DWORD       *pFunctions;    // AddressOfFunctions
+            DWORD        cFunctions,
+                         OrdinalBase,
+                         ExportRva,     // rvas inside the export directory are forwarders
+                         cbExport,
+                         cNames;
+            EXPORT_NAME *pNames,        // sorted by name (owned)
+                        *pNamesByHint;  // AddressOfNames order, same as pNames if that was already sorted
+            void        *Flink;
+        } BIND_MODULE;     // dependency indexed for PlBindImports
+
+        typedef struct _DEPENDENCY_NODE {
+            BIND_MODULE    *pbm;            // file on disk, from the bind cache
+            VIRTUAL_MODULE  vm;             // image once PlLoadDependencyGraph mapped it
+            DWORD          *pEdges;         // nodes this one imports from (owned)
+            DWORD           cEdges,
+                            dwLevel,        // loads after every lower level, 0 imports nothing in the graph
+                            dwComponent;    // strongly connected component, modules on one cycle share it
+            BOOL            bCycle;         // imports itself through other modules
+            LOGICAL         lLoaded;        // result of mapping and binding it
+        } DEPENDENCY_NODE;
+
+        typedef struct _DEPENDENCY_GRAPH {
+            DEPENDENCY_NODE *pNodes;        // roots first (owned)
+            DWORD           *pOrder,        // node indices, dependencies before dependents (owned)
+                            *pLevelStart;   // pOrder index each level starts at, cLevels + 1 entries (owned)
+            size_t           cNodes,
+                             cMaxNodes,     // capacity of pNodes
+                             cLevels,
+                             cMissing;      // imported libraries that couldn't be found
+            BOOL             bCycles;
+        } DEPENDENCY_GRAPH; // transitive imports of a set of modules
+
+        typedef struct _TLS_INFO {
+            TLS_DIRECTORY  *ptdDir;         // ptr into image
+            void           *pTemplate;      // StartAddressOfRawData, ptr into image
+            size_t          cbTemplate;     // EndAddressOfRawData - StartAddressOfRawData
+            DWORD           cbZeroFill,     // SizeOfZeroFill, zeroed after the template
+                            dwAlignment;    // alignment of a block (IMAGE_SCN_ALIGN_XXX in Characteristics, 0x10 at least)
+            DWORD          *pdwIndex;       // AddressOfIndex, ptr into image (NULL if there is none)
+            PTR            *pCallbacks;     // AddressOfCallBacks, ptr into image, VAs ending with 0 (NULL if there are none)
+            size_t          cCallbacks;
+        } TLS_INFO;        // TLS directory resolved to pointers
+
+        typedef struct _TLS_POOL {
+            CRITICAL_SECTION csLock;
+            TLS_INFO        Info;           // parsed once by PlGetTlsInfo
+            size_t          cbBlock;        // template + zero fill, aligned to Info.dwAlignment
+            void           *pSlabs,         // forward-linked list of slabs blocks are carved from
+                           *pFree;          // forward-linked list of freed blocks (link is the first PTR of a block)
+            BYTE           *pCarve;         // next uncarved block of newest slab
+            size_t          cCarve;         // blocks left in newest slab
+        } TLS_POOL;        // per-thread TLS blocks of one image
+
+        typedef struct _FUNCTION_ENTRY {
+            DWORD           BeginAddress,   // rva of first byte
+                            EndAddress,     // rva past last byte
+                            UnwindData;     // rva of UNWIND_INFO
+        } FUNCTION_ENTRY;  // x64 RUNTIME_FUNCTION, exception directory (.pdata) entry
+
+        typedef struct _FUNCTION_TABLE {
+            const FUNCTION_ENTRY *pEntries; // sorted by BeginAddress, ptr into image or pOwned
+            FUNCTION_ENTRY *pOwned;         // sorted copy, only if the image's table wasn't (owned)
+            size_t          cEntries;
+        } FUNCTION_TABLE;  // validated exception directory
+
+        typedef struct _LOAD_CONFIG_DIRECTORY32 {
+            DWORD   Size,                   // cb of the fields the linker knew about, the rest reads as 0
+                    TimeDateStamp;
+            WORD    MajorVersion,
+                    MinorVersion;
+            DWORD   GlobalFlagsClear,
+                    GlobalFlagsSet,
+                    CriticalSectionDefaultTimeout,
+                    DeCommitFreeBlockThreshold,
+                    DeCommitTotalFreeThreshold,
+                    LockPrefixTable,
+                    MaximumAllocationSize,
+                    VirtualMemoryThreshold,
+                    ProcessHeapFlags,
+                    ProcessAffinityMask;
+            WORD    CSDVersion,
+                    DependentLoadFlags;
+            DWORD   EditList,
+                    SecurityCookie,
+                    SEHandlerTable,
+                    SEHandlerCount,
+                    GuardCFCheckFunctionPointer,
+                    GuardCFDispatchFunctionPointer,
+                    GuardCFFunctionTable,   // va of rva + (GuardFlags & GUARD_CF_STRIDE_MASK) >> GUARD_CF_STRIDE_SHIFT bytes entries
+                    GuardCFFunctionCount,
+                    GuardFlags;
+        } LOAD_CONFIG_DIRECTORY32;    // IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG, sdks before win8.1 don't have the guard fields
+
+        typedef struct _LOAD_CONFIG_DIRECTORY64 {
+            DWORD   Size,
+                    TimeDateStamp;
+            WORD    MajorVersion,
+                    MinorVersion;
+            DWORD   GlobalFlagsClear,
+                    GlobalFlagsSet,
+                    CriticalSectionDefaultTimeout;
+            PTR64   DeCommitFreeBlockThreshold,
+                    DeCommitTotalFreeThreshold,
+                    LockPrefixTable,
+                    MaximumAllocationSize,
+                    VirtualMemoryThreshold,
+                    ProcessAffinityMask;
+            DWORD   ProcessHeapFlags;
+            WORD    CSDVersion,
+                    DependentLoadFlags;
+            PTR64   EditList,
+                    SecurityCookie,
+                    SEHandlerTable,
+                    SEHandlerCount,
+                    GuardCFCheckFunctionPointer,
+                    GuardCFDispatchFunctionPointer,
+                    GuardCFFunctionTable,
+                    GuardCFFunctionCount;
+            DWORD   GuardFlags;
+        } LOAD_CONFIG_DIRECTORY64;
+
+#if SUPPORT_PE32PLUS
+        typedef LOAD_CONFIG_DIRECTORY64 LOAD_CONFIG_DIRECTORY;
+#else
+        typedef LOAD_CONFIG_DIRECTORY32 LOAD_CONFIG_DIRECTORY;
+#endif
+
+        typedef struct _GUARD_CF_BITMAP {
+            BYTE           *pBits;          // 2 bits per 16 bytes of image, valid at the start of the slot | valid anywhere in it (owned)
+            DWORD           cbImage;        // SizeOfImage the bitmap covers
+            size_t          cTargets;       // GuardCFFunctionTable entries set in pBits
+        } GUARD_CF_BITMAP; // control flow guard call targets
+
+        typedef struct _CODEVIEW_INFO {
+            DEBUG_DIRECTORY *pddEntry;      // CodeView entry of the debug directory, ptr into PE
+            DWORD            dwSignature;   // CODEVIEW_SIGNATURE_RSDS or CODEVIEW_SIGNATURE_NB10
+            GUID             Guid;          // RSDS only
+            DWORD            dwTimeStamp,   // NB10 only, stands in for the guid
+                             dwAge;         // bumped by every incremental link
+            const char      *szPdbPath;     // ptr into PE, as the linker wrote it
+        } CODEVIEW_INFO;   // identity of the pdb matching an image (symbol server key)
 #	pragma pack(pop)
 #pragma endregion
 
@@ -194,6 +513,8 @@
 
         DWORD LIBCALL PlSectionToPageProtection(IN const DWORD dwCharacteristics);
         DWORD LIBCALL PlPageToSectionProtection(IN const DWORD dwProtection);
+
+        PTR64 LIBCALL PlHashData(IN const void* pData, IN const size_t cbData);
 #   pragma endregion
 #   pragma region Raw
 // these can operate on any filled RAW_PE regardless of alignment
@@ -208,14 +529,21 @@
         LOGICAL LIBCALL PlWritePa(INOUT RAW_PE* rpe, IN const PTR Pa, IN const void* pData, IN size_t cbData);
         LOGICAL LIBCALL PlReadPa(IN const RAW_PE* rpe, IN const PTR Pa, IN void* pBuffer, IN size_t cbBufferMax);
 
+        LOGICAL LIBCALL PlTrackDirty(INOUT RAW_PE* rpe, IN const BOOL bEnable);
+        LOGICAL LIBCALL PlFlushDirty(INOUT RAW_PE* rpe, IN HANDLE hFile, IN const BOOL bChecksum);
+
         LOGICAL LIBCALL PlRvaToVa(IN const VIRTUAL_MODULE* vm, IN const PTR Rva, OUT PTR* Va);
         LOGICAL LIBCALL PlPaToVa(IN const VIRTUAL_MODULE* vm, IN const PTR Pa, OUT PTR* Va);
 
         LOGICAL LIBCALL PlMaxPa(IN const RAW_PE* rpe, OUT PTR* MaxPa);
         LOGICAL LIBCALL PlMaxRva(IN const RAW_PE* rpe, OUT PTR* MaxRva);
+
+        LOGICAL LIBCALL PlGetOverlay(IN const RAW_PE* rpe, OUT OVERLAY_VIEW* ov);
     
         LOGICAL LIBCALL PlEnumerateImports(INOUT RAW_PE* rpe);
         LOGICAL LIBCALL PlFreeEnumeratedImports(INOUT RAW_PE* rpe);
+        LOGICAL LIBCALL PlGetBoundImports(IN const RAW_PE* rpe, OUT BOUND_IMPORT_DESCRIPTOR** ppbid, OUT PTR* pcbDir);
+        LOGICAL LIBCALL PlGetCodeViewInfo(IN const RAW_PE* rpe, OUT CODEVIEW_INFO* pcvi);
 
         LOGICAL LIBCALL PlEnumerateExports(INOUT RAW_PE* rpe);
         LOGICAL LIBCALL PlFreeEnumeratedExports(INOUT RAW_PE* rpe);
@@ -226,13 +554,100 @@
 
         LOGICAL LIBCALL PlSizeofPeHeaders(IN const RAW_PE* rpe, OUT PTR* SizeofHeaders);
 #   pragma endregion
+#   pragma region Resource
+// these can operate on any filled RAW_PE regardless of alignment
+#       define RESOURCE_ANY_LANGUAGE ((PTR)-1)
+
+        LOGICAL LIBCALL PlFirstResource(IN const RAW_PE* rpe, OUT RESOURCE_ITERATOR* ri, OUT RESOURCE_LIST* rl);
+        LOGICAL LIBCALL PlNextResource(INOUT RESOURCE_ITERATOR* ri, OUT RESOURCE_LIST* rl);
+
+        LOGICAL LIBCALL PlFindResource(IN const RAW_PE* rpe, IN const PTR dwType, IN const PTR wId, IN const PTR wLang, OUT RESOURCE_LIST* rl);
+
+        LOGICAL LIBCALL PlGetVersionInfo(IN const RAW_PE* rpe, OUT VERSION_INFO* vi);
+        LOGICAL LIBCALL PlQueryVersionString(IN const VERSION_INFO* vi, IN const char* szKey, OUT const WCHAR** pszValue);
+
+        LOGICAL LIBCALL PlEnumerateResources(INOUT RAW_PE* rpe);
+        LOGICAL LIBCALL PlFreeEnumeratedResources(INOUT RAW_PE* rpe);
+#   pragma endregion
+#   pragma region Codecave
+// file aligned RAW_PE only, cbMinimum of 0 uses the default (0x10)
+        LOGICAL LIBCALL PlEnumerateCodecaves(INOUT RAW_PE* rpe, IN const size_t cbMinimum);
+        LOGICAL LIBCALL PlFreeEnumeratedCodecaves(INOUT RAW_PE* rpe);
+#   pragma endregion
+#   pragma region Context
+        LOGICAL LIBCALL PlCreateContext(OUT PEEL_CONTEXT* ctx, IN const size_t cbPoolMax);
+        LOGICAL LIBCALL PlDestroyContext(INOUT PEEL_CONTEXT* ctx);
+        LOGICAL LIBCALL PlEnableLargePages(INOUT PEEL_CONTEXT* ctx);
+
+// ctx can be NULL for plain VirtualAlloc/VirtualFree
+        LOGICAL LIBCALL PlPoolAlloc(INOUT PEEL_CONTEXT* ctx, IN const size_t cbSize, OUT void** ppBuffer);
+        LOGICAL LIBCALL PlPoolFree(INOUT PEEL_CONTEXT* ctx, IN void* pBuffer, IN const size_t cbSize);
+        LOGICAL LIBCALL PlPrefillPool(INOUT PEEL_CONTEXT* ctx, IN const size_t cbSize, IN const size_t cBuffers);
+        LOGICAL LIBCALL PlTrimPool(INOUT PEEL_CONTEXT* ctx, IN const BOOL bRelease);
+#   pragma endregion
+#   pragma region Copy
+        LOGICAL LIBCALL PlCopyMemory(OUT void* pDest, IN const void* pSource, IN const size_t cbSize);
+        LOGICAL LIBCALL PlZeroGaps(INOUT void* pBuffer, IN const size_t cbBuffer, INOUT COPY_RANGE* pRanges, IN const size_t cRanges);
+#   pragma endregion
+#   pragma region Template
+        LOGICAL LIBCALL PlGetFileIdentity(IN const RAW_PE* rpe, OUT PTR64* pqwKey);
+        LOGICAL LIBCALL PlGetTemplate(INOUT PEEL_CONTEXT* ctx, IN const RAW_PE* rpe, OUT IMAGE_TEMPLATE** pptpl);
+        LOGICAL LIBCALL PlInstantiateTemplate(IN const IMAGE_TEMPLATE* tpl, OUT VIRTUAL_MODULE* vm);
+        LOGICAL LIBCALL PlFreeTemplates(INOUT PEEL_CONTEXT* ctx);
+#   pragma endregion
+#   pragma region Bind
+        LOGICAL LIBCALL PlGetBindModule(INOUT PEEL_CONTEXT* ctx, IN const char* szLibrary, IN LPCTSTR szSearchPath, OUT BIND_MODULE** ppbm);
+        LOGICAL LIBCALL PlResolveExport(INOUT PEEL_CONTEXT* ctx, IN const BIND_MODULE* pbm, IN const char* szName, IN const WORD wHintOrdinal, IN LPCTSTR szSearchPath, OUT PTR* pAddress);
+        LOGICAL LIBCALL PlValidateBoundImports(INOUT PEEL_CONTEXT* ctx, INOUT RAW_PE* rpe, OUT BOOL* pbValid);
+        LOGICAL LIBCALL PlBindImports(INOUT PEEL_CONTEXT* ctx, INOUT RAW_PE* rpe, IN LPCTSTR szSearchPath);
+        LOGICAL LIBCALL PlFreeBindCache(INOUT PEEL_CONTEXT* ctx);
+#   pragma endregion
+#   pragma region Registry
+        LOGICAL LIBCALL PlRegisterModule(INOUT PEEL_CONTEXT* ctx, IN const char* szName, IN VIRTUAL_MODULE* vm, OUT MODULE_ENTRY** ppme);
+        LOGICAL LIBCALL PlReleaseModule(INOUT PEEL_CONTEXT* ctx, INOUT MODULE_ENTRY* pme, OUT BOOL* pbRemoved);
+        LOGICAL LIBCALL PlUnregisterImage(INOUT PEEL_CONTEXT* ctx, IN const VIRTUAL_MODULE* vm);
+        LOGICAL LIBCALL PlFindModule(INOUT PEEL_CONTEXT* ctx, IN const char* szName, OUT MODULE_ENTRY** ppme);
+        LOGICAL LIBCALL PlFindModuleByBase(INOUT PEEL_CONTEXT* ctx, IN const PTR Base, OUT MODULE_ENTRY** ppme);
+        LOGICAL LIBCALL PlFindModuleByAddress(INOUT PEEL_CONTEXT* ctx, IN const PTR Address, OUT MODULE_ENTRY** ppme);
+        LOGICAL LIBCALL PlFreeRegistry(INOUT PEEL_CONTEXT* ctx);
+#   pragma endregion
+#   pragma region Graph
+        LOGICAL LIBCALL PlBuildDependencyGraph(INOUT PEEL_CONTEXT* ctx, IN const char* const* pszModules, IN const size_t cModules, IN LPCTSTR szSearchPath, OUT DEPENDENCY_GRAPH* pdg);
+        LOGICAL LIBCALL PlLoadDependencyGraph(INOUT PEEL_CONTEXT* ctx, INOUT DEPENDENCY_GRAPH* pdg, IN LPCTSTR szSearchPath);
+        LOGICAL LIBCALL PlFreeDependencyGraph(INOUT DEPENDENCY_GRAPH* pdg);
+#   pragma endregion
+#   pragma region TLS
+        LOGICAL LIBCALL PlGetTlsInfo(IN const RAW_PE* rpe, OUT TLS_INFO* pti);
+        LOGICAL LIBCALL PlCreateTlsPool(IN const TLS_INFO* pti, OUT TLS_POOL* ptp);
+        LOGICAL LIBCALL PlAllocTlsBlock(INOUT TLS_POOL* ptp, OUT void** ppBlock);
+        LOGICAL LIBCALL PlFreeTlsBlock(INOUT TLS_POOL* ptp, IN void* pBlock);
+        LOGICAL LIBCALL PlDestroyTlsPool(INOUT TLS_POOL* ptp);
+#   pragma endregion
+#   pragma region Exception
+        LOGICAL LIBCALL PlGetFunctionTable(IN const RAW_PE* rpe, OUT FUNCTION_TABLE* pft);
+        LOGICAL LIBCALL PlFreeFunctionTable(INOUT FUNCTION_TABLE* pft);
+        LOGICAL LIBCALL PlLookupFunctionEntry(IN const FUNCTION_TABLE* pft, IN const DWORD Rva, OUT const FUNCTION_ENTRY** ppfe);
+        LOGICAL LIBCALL PlLookupFunctionEntries(IN const FUNCTION_TABLE* pft, IN const DWORD* pRvas, IN const size_t cRvas, OUT const FUNCTION_ENTRY** ppfe);
+#   pragma endregion
+#   pragma region Load Config
+        LOGICAL LIBCALL PlGetLoadConfig(IN const RAW_PE* rpe, OUT LOAD_CONFIG_DIRECTORY* plcd);
+        LOGICAL LIBCALL PlGetGuardCFBitmap(IN const RAW_PE* rpe, OUT GUARD_CF_BITMAP* pgcb);
+        LOGICAL LIBCALL PlIsGuardCFTarget(IN const GUARD_CF_BITMAP* pgcb, IN const DWORD Rva);
+        LOGICAL LIBCALL PlFreeGuardCFBitmap(INOUT GUARD_CF_BITMAP* pgcb);
+#   pragma endregion
 #   pragma region File
 // these will only work on file aligned PEs
         LOGICAL LIBCALL PlAttachFile(IN const void* const pFileBase, OUT RAW_PE* rpe);
+        LOGICAL LIBCALL PlAttachFileEx(IN const void* const pFileBase, IN const size_t cbFile, OUT RAW_PE* rpe);
         LOGICAL LIBCALL PlDetachFile(INOUT RAW_PE* rpe);
 
+        LOGICAL LIBCALL PlOpenFile(IN LPCTSTR szFileName, OUT RAW_PE* rpe);
+
         LOGICAL LIBCALL PlFileToImage(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm);
         LOGICAL LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuffer, OUT VIRTUAL_MODULE* vm);
+        LOGICAL LIBCALL PlFileToImageMapped(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm);
+        LOGICAL LIBCALL PlFileToImageAt(IN const RAW_PE* rpe, IN const PTR PreferredBase, OUT VIRTUAL_MODULE* vm);
+        LOGICAL LIBCALL PlPlanImageBases(IN const RAW_PE* prpe, IN const size_t cModules, OUT PTR* pBases);
 
         LOGICAL LIBCALL PlCopyFile(IN const RAW_PE* rpe, OUT RAW_PE* crpe);
         LOGICAL LIBCALL PlCopyFileEx(IN const RAW_PE* rpe, IN void* pBuffer, OUT RAW_PE* crpe);
@@ -252,6 +667,16 @@
         LOGICAL LIBCALL PlCopyImage(IN VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cvm);
         LOGICAL LIBCALL PlCopyImageEx(IN VIRTUAL_MODULE* vm, IN const void* pBuffer, OUT VIRTUAL_MODULE* cvm);
 
+        LOGICAL LIBCALL PlShareImage(INOUT VIRTUAL_MODULE* vm);
+        LOGICAL LIBCALL PlCopyImageCow(INOUT VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cvm);
+
+        LOGICAL LIBCALL PlSnapshotImage(IN VIRTUAL_MODULE* vm, OUT IMAGE_SNAPSHOT* snap);
+        LOGICAL LIBCALL PlRestoreImage(INOUT IMAGE_SNAPSHOT* snap);
+        LOGICAL LIBCALL PlFreeSnapshot(INOUT IMAGE_SNAPSHOT* snap);
+
+        LOGICAL LIBCALL PlPlanProtection(IN const VIRTUAL_MODULE* vm, OUT PROTECT_PLAN* pp);
+        LOGICAL LIBCALL PlFreeProtectionPlan(INOUT PROTECT_PLAN* pp);
+
         LOGICAL LIBCALL PlProtectImage(INOUT VIRTUAL_MODULE* vm);
         LOGICAL LIBCALL PlUnprotectImage(INOUT VIRTUAL_MODULE* vm);
 
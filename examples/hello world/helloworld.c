@@ -38,21 +38,23 @@ int main(int argc, char* argv[]) {
         if (!LOGICAL_SUCCESS(PlAttachFile(test_exe, &rpe)))
             return 0;
         printf("File aligned PE at %p", rpe.pDosHdr);
-        if (!LOGICAL_SUCCESS(PlFileToImage(&rpe, &vm))) {
+        // loads at ImageBase if it's free, relocates otherwise
+        if (!LOGICAL_SUCCESS(PlFileToImageAt(&rpe, 0, &vm))) {
             PlDetachFile(&rpe);
             return 0;
         }
         PlDetachFile(&rpe);
     }
     printf("\nImage aligned PE at %p", vm.pBaseAddr);
-    // 1. Relocate (we know our image has a .reloc section)
-    if ((void*)vm.PE.pNtHdr->OptionalHeader.ImageBase != vm.pBaseAddr) {
-        PlRelocate(&vm.PE, vm.PE.pNtHdr->OptionalHeader.ImageBase, (PTR)vm.pBaseAddr);
-        printf("\nPE typically at %p was relocated to %p", (void*)vm.PE.pNtHdr->OptionalHeader.ImageBase, vm.pBaseAddr);
-    }
+    // 1. Relocate (PlFileToImageAt already did if it had to)
+    if (vm.PE.LoadStatus.Relocated)
+        printf("\nPE was relocated to %p", vm.pBaseAddr);
     // 2. Import (yeah i know this is a terrible way, but I'm lazy and this is only an example)
     PlEnumerateImports(&vm.PE);
     for (IMPORT_LIBRARY* pIL = vm.PE.pImport; pIL != NULL; pIL = (IMPORT_LIBRARY*)pIL->Flink) {
+        // delay loaded libraries are loaded by the image's own helper when first called
+        if (pIL->pDelayDesc != NULL)
+            continue;
         printf("\nLoading library %s", pIL->Library);
         HMODULE hLib = LoadLibraryA(pIL->Library);
         for (IMPORT_ITEM* pII = pIL->iiImportList; pII != NULL; pII = (IMPORT_ITEM*)pII->Flink) {
@@ -82,6 +84,8 @@ int main(int argc, char* argv[]) {
 
     printf("\nIf we reached here then our loaded file did not call exit()");
     for (IMPORT_LIBRARY* pIL = vm.PE.pImport; pIL != NULL; pIL = (IMPORT_LIBRARY*)pIL->Flink) {
+        if (pIL->pDelayDesc != NULL)
+            continue;
         if (GetModuleHandleA(pIL->Library) != NULL) 
             FreeLibrary(GetModuleHandleA(pIL->Library));
     }
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bind.h"
+
+/// <summary>
+///	Compares two ascii strings ignoring case, module names are case insensitive </summary>
+static int PlCompareNoCase(IN const char* szA, IN const char* szB) {
+    char a = 0,
+         b = 0;
+
+    do {
+        a = *szA++;
+        b = *szB++;
+        if (a >= 'A' && a <= 'Z')
+            a += 'a' - 'A';
+        if (b >= 'A' && b <= 'Z')
+            b += 'a' - 'A';
+    } while (a && a == b);
+    return (unsigned char)a - (unsigned char)b;
+}
+
+static int PlCompareExportNames(IN const void* pA, IN const void* pB) {
+    return strcmp(((const EXPORT_NAME*)pA)->Name, ((const EXPORT_NAME*)pB)->Name);
+}
+
+/// <summary>
+///	Reads a dependency's export directory once, names are copied into a sorted index </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlIndexExports(INOUT BIND_MODULE* pbm) {
+    const RAW_PE     *rpe = &pbm->PE;
+    EXPORT_DIRECTORY *pED = NULL;
+    DWORD            *pdwNames = NULL;
+    WORD             *pwOrdinals = NULL;
+    BOOL              bSorted = TRUE;
+
+    pbm->ExportRva = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
+    pbm->cbExport = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size;
+    if (!pbm->ExportRva || !pbm->cbExport)
+        return LOGICAL_TRUE;
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pbm->ExportRva, (PTR*)&pED)))
+        return LOGICAL_FALSE;
+    pbm->OrdinalBase = pED->Base;
+    if (pED->NumberOfFunctions) {
+        if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pED->AddressOfFunctions, (PTR*)&pbm->pFunctions)))
+            return LOGICAL_FALSE;
+        pbm->cFunctions = pED->NumberOfFunctions;
+    }
+    if (!pED->NumberOfNames)
+        return LOGICAL_TRUE;
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pED->AddressOfNames, (PTR*)&pdwNames))
+     || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pED->AddressOfNameOrdinals, (PTR*)&pwOrdinals)))
+        return LOGICAL_FALSE;
+    pbm->pNames = malloc(pED->NumberOfNames * sizeof(*pbm->pNames));
+    if (pbm->pNames == NULL)
+        return LOGICAL_MAYBE;
+    for (register DWORD i = 0; i < pED->NumberOfNames; ++i) {
+        if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pdwNames[i], (PTR*)&pbm->pNames[i].Name)))
+            return LOGICAL_FALSE;
+        pbm->pNames[i].wIndex = pwOrdinals[i];
+        if (i && strcmp(pbm->pNames[i - 1].Name, pbm->pNames[i].Name) > 0)
+            bSorted = FALSE;
+    }
+    pbm->cNames = pED->NumberOfNames;
+    pbm->pNamesByHint = pbm->pNames;
+    // the linker always sorts them, hand made tables might not be (hints index the unsorted table)
+    if (!bSorted) {
+        pbm->pNamesByHint = malloc(pbm->cNames * sizeof(*pbm->pNamesByHint));
+        if (pbm->pNamesByHint == NULL)
+            return LOGICAL_MAYBE;
+        memcpy(pbm->pNamesByHint, pbm->pNames, pbm->cNames * sizeof(*pbm->pNamesByHint));
+        qsort(pbm->pNames, pbm->cNames, sizeof(*pbm->pNames), PlCompareExportNames);
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Releases a dependency that was never linked (or was just unlinked) </summary>
+static void PlFreeBindModule(INOUT BIND_MODULE* pbm) {
+    // PlBuildDependencyGraph enumerates the imports of cached files
+    if (pbm->PE.pImport != NULL)
+        PlFreeEnumeratedImports(&pbm->PE);
+    if (pbm->PE.pDosHdr != NULL)
+        PlFreeFile(&pbm->PE);
+    if (pbm->pNamesByHint != NULL && pbm->pNamesByHint != pbm->pNames)
+        free(pbm->pNamesByHint);
+    if (pbm->pNames != NULL)
+        free(pbm->pNames);
+    if (pbm->Library != NULL)
+        free(pbm->Library);
+    free(pbm);
+}
+
+/// <summary>
+///	Looks a dependency up in the bind cache, caller holds ctx->csLock </summary>
+///
+/// <returns>
+/// Dependency, NULL if it isn't cached </returns>
+static BIND_MODULE* PlFindBindModule(IN const PEEL_CONTEXT* ctx, IN const char* szLibrary) {
+    BIND_MODULE *pbm = NULL;
+
+    for (pbm = ctx->pBindCache; pbm != NULL; pbm = (BIND_MODULE*)pbm->Flink) {
+        if (!PlCompareNoCase(pbm->Library, szLibrary))
+            return pbm;
+    }
+    return NULL;
+}
+
+/// <summary>
+///	Finds a dependency in the context's bind cache, opening it from the search path and indexing its
+/// exports the first time it's asked for. That happens outside of the context lock, if another thread
+/// cached the same dependency meanwhile its entry wins and ours is dropped </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT that owns the cache </param>
+/// <param name="szLibrary">
+/// File name of dependency (case insensitive) </param>
+/// <param name="szSearchPath">
+/// ';' separated directories to look in, NULL for the current directory </param>
+/// <param name="ppbm">
+/// Pointer that will recieve dependency, valid until PlFreeBindCache </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if it can't be found or isn't a valid PE, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlGetBindModule(INOUT PEEL_CONTEXT* ctx, IN const char* szLibrary, IN LPCTSTR szSearchPath, OUT BIND_MODULE** ppbm) {
+    BIND_MODULE *pbm = NULL,
+                *pbmCached = NULL;
+    TCHAR        szPath[MAX_PATH];
+    LPCTSTR      szDir = szSearchPath != NULL ? szSearchPath : TEXT("");
+    size_t       cchPath = 0,
+                 cchLibrary = strlen(szLibrary);
+    LOGICAL      lResult = LOGICAL_FALSE;
+
+    *ppbm = NULL;
+    EnterCriticalSection(&ctx->csLock);
+    pbmCached = PlFindBindModule(ctx, szLibrary);
+    LeaveCriticalSection(&ctx->csLock);
+    if (pbmCached != NULL) {
+        *ppbm = pbmCached;
+        return LOGICAL_TRUE;
+    }
+    pbm = calloc(1, sizeof(*pbm));
+    if (pbm == NULL)
+        return LOGICAL_MAYBE;
+    // try every directory until one has it
+    for (;;) {
+        for (cchPath = 0; *szDir && *szDir != TEXT(';') && cchPath < MAX_PATH; ++szDir)
+            szPath[cchPath++] = *szDir;
+        if (cchPath && szPath[cchPath - 1] != TEXT('\\') && szPath[cchPath - 1] != TEXT('/') && cchPath < MAX_PATH)
+            szPath[cchPath++] = TEXT('\\');
+        if (cchPath + cchLibrary < MAX_PATH) {
+            // import names are ascii
+            for (register size_t i = 0; i <= cchLibrary; ++i)
+                szPath[cchPath + i] = (TCHAR)(unsigned char)szLibrary[i];
+            lResult = PlOpenFile(szPath, &pbm->PE);
+            if (LOGICAL_SUCCESS(lResult))
+                break;
+        }
+        if (*szDir != TEXT(';'))
+            break;
+        ++szDir;
+    }
+    if (!LOGICAL_SUCCESS(lResult)) {
+        dmsg(TEXT("\nCould not find dependency %hs"), szLibrary);
+        PlFreeBindModule(pbm);
+        return LOGICAL_FALSE;
+    }
+    pbm->Library = malloc(cchLibrary + 1);
+    lResult = pbm->Library != NULL ? PlIndexExports(pbm) : LOGICAL_MAYBE;
+    if (!LOGICAL_SUCCESS(lResult)) {
+        PlFreeBindModule(pbm);
+        return lResult;
+    }
+    for (register size_t i = 0; i <= cchLibrary; ++i)
+        pbm->Library[i] = szLibrary[i] >= 'A' && szLibrary[i] <= 'Z' ? szLibrary[i] + 'a' - 'A' : szLibrary[i];
+    pbm->Base = pbm->PE.pNtHdr->OptionalHeader.ImageBase;
+    EnterCriticalSection(&ctx->csLock);
+    pbmCached = PlFindBindModule(ctx, szLibrary);
+    if (pbmCached == NULL) {
+        pbm->Flink = ctx->pBindCache;
+        ctx->pBindCache = pbm;
+    }
+    LeaveCriticalSection(&ctx->csLock);
+    if (pbmCached != NULL) {
+        PlFreeBindModule(pbm);
+        pbm = pbmCached;
+    }
+    *ppbm = pbm;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Resolves an export, following forwarders through the bind cache </summary>
+static LOGICAL PlResolveExportInternal(INOUT PEEL_CONTEXT* ctx, IN const BIND_MODULE* pbm, IN const char* szName, IN const WORD wHintOrdinal,
+                                       IN LPCTSTR szSearchPath, IN const int iDepth, OUT PTR* pAddress) {
+    BIND_MODULE *pbmForward = NULL;
+    const char  *szForward = NULL,
+                *szDot = NULL;
+    char         szLibrary[MAX_PATH];
+    size_t       iLow = 0,
+                 iHigh = pbm->cNames,
+                 iMid = 0,
+                 iIndex = (size_t)-1;
+    WORD         wForwardOrdinal = 0;
+    int          iCompare = 0;
+    DWORD        Rva = 0;
+
+    if (szName != NULL) {
+        // against the version it was linked with the hint is right, that's one compare instead of a search
+        if (wHintOrdinal < pbm->cNames && !strcmp(szName, pbm->pNamesByHint[wHintOrdinal].Name)) {
+            iIndex = pbm->pNamesByHint[wHintOrdinal].wIndex;
+            iHigh = 0;
+        }
+        while (iLow < iHigh) {
+            iMid = iLow + (iHigh - iLow) / 2;
+            iCompare = strcmp(szName, pbm->pNames[iMid].Name);
+            if (!iCompare) {
+                iIndex = pbm->pNames[iMid].wIndex;
+                break;
+            }
+            if (iCompare < 0)
+                iHigh = iMid;
+            else
+                iLow = iMid + 1;
+        }
+    } else if (wHintOrdinal >= pbm->OrdinalBase)
+        iIndex = wHintOrdinal - pbm->OrdinalBase;
+    if (iIndex >= pbm->cFunctions || !pbm->pFunctions[iIndex])
+        return LOGICAL_FALSE;
+    Rva = pbm->pFunctions[iIndex];
+    if (Rva < pbm->ExportRva || Rva >= pbm->ExportRva + pbm->cbExport) {
+        *pAddress = pbm->Base + Rva;
+        return LOGICAL_TRUE;
+    }
+    // forwarded to "library.name" or "library.#ordinal"
+    if (iDepth >= MAX_FORWARD_DEPTH || !LOGICAL_SUCCESS(PlGetRvaPtr(&pbm->PE, Rva, (PTR*)&szForward)))
+        return LOGICAL_FALSE;
+    for (register const char* p = szForward; *p; ++p)
+        if (*p == '.')
+            szDot = p;
+    if (szDot == NULL || (size_t)(szDot - szForward) + sizeof(".dll") > sizeof(szLibrary))
+        return LOGICAL_FALSE;
+    memcpy(szLibrary, szForward, szDot - szForward);
+    memcpy(szLibrary + (szDot - szForward), ".dll", sizeof(".dll"));
+    if (!LOGICAL_SUCCESS(PlGetBindModule(ctx, szLibrary, szSearchPath, &pbmForward)))
+        return LOGICAL_FALSE;
+    if (szDot[1] != '#')
+        return PlResolveExportInternal(ctx, pbmForward, szDot + 1, 0, szSearchPath, iDepth + 1, pAddress);
+    for (register const char* p = szDot + 2; *p >= '0' && *p <= '9'; ++p)
+        wForwardOrdinal = wForwardOrdinal * 10 + (*p - '0');
+    return PlResolveExportInternal(ctx, pbmForward, NULL, wForwardOrdinal, szSearchPath, iDepth + 1, pAddress);
+}
+
+/// <summary>
+///	Finds the address an export will have once its module is loaded at pbm->Base </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT forwarded exports are looked up in </param>
+/// <param name="pbm">
+/// Dependency from PlGetBindModule </param>
+/// <param name="szName">
+/// Export name, NULL to resolve by ordinal </param>
+/// <param name="wHintOrdinal">
+/// Hint (IMPORT_ITEM::Hint) if szName isn't NULL, export ordinal otherwise </param>
+/// <param name="szSearchPath">
+/// ';' separated directories forwarded modules are looked for in </param>
+/// <param name="pAddress">
+/// Pointer that will recieve address </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if export doesn't exist </returns>
+LOGICAL EXPORT LIBCALL PlResolveExport(INOUT PEEL_CONTEXT* ctx, IN const BIND_MODULE* pbm, IN const char* szName, IN const WORD wHintOrdinal, IN LPCTSTR szSearchPath, OUT PTR* pAddress) {
+    return PlResolveExportInternal(ctx, pbm, szName, wHintOrdinal, szSearchPath, 0, pAddress);
+}
+
+/// <summary>
+///	Checks whether a registered module is the one a bound import was bound against </summary>
+static BOOL PlIsBoundModule(INOUT PEEL_CONTEXT* ctx, IN const char* szLibrary, IN const DWORD dwTimeDateStamp) {
+    MODULE_ENTRY *pme = NULL;
+
+    if (!dwTimeDateStamp || !LOGICAL_SUCCESS(PlFindModule(ctx, szLibrary, &pme)))
+        return FALSE;
+    // bound addresses assume the library sits at its own ImageBase
+    return pme->vm->PE.pNtHdr->FileHeader.TimeDateStamp == dwTimeDateStamp && !pme->vm->PE.LoadStatus.Relocated;
+}
+
+/// <summary>
+///	Checks if a bound image's IAT is still valid, that is every dependency (and every module a forwarder
+/// was bound to) is registered with the TimeDateStamp it was bound against and wasn't relocated </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT holding the module registry </param>
+/// <param name="rpe">
+/// Loaded RAW_PE, imports are enumerated first if they aren't yet </param>
+/// <param name="pbValid">
+/// Receives TRUE if binding can be skipped </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlValidateBoundImports(INOUT PEEL_CONTEXT* ctx, INOUT RAW_PE* rpe, OUT BOOL* pbValid) {
+    IMPORT_LIBRARY          *pIL = NULL;
+    BOUND_IMPORT_DESCRIPTOR *pbidFirst = NULL,
+                            *pbid = NULL;
+    BOUND_FORWARDER_REF     *pbfr = NULL;
+    PTR                      cbBound = 0;
+    LOGICAL                  lResult = LOGICAL_FALSE;
+
+    *pbValid = FALSE;
+    if (rpe->pImport == NULL) {
+        lResult = PlEnumerateImports(rpe);
+        if (!LOGICAL_SUCCESS(lResult))
+            return lResult;
+    }
+    for (pIL = rpe->pImport; pIL != NULL; pIL = (IMPORT_LIBRARY*)pIL->Flink) {
+        if (pIL->Library == NULL || pIL->pDelayDesc != NULL)
+            continue;
+        if (!PlIsBoundModule(ctx, pIL->Library, pIL->BoundTimeDateStamp))
+            return LOGICAL_TRUE;
+    }
+    if (LOGICAL_SUCCESS(PlGetBoundImports(rpe, &pbidFirst, &cbBound))) {
+        for (pbid = pbidFirst; (PTR)(pbid + 1) <= (PTR)pbidFirst + cbBound && pbid->OffsetModuleName; pbid += 1 + pbid->NumberOfModuleForwarderRefs) {
+            pbfr = (BOUND_FORWARDER_REF*)(pbid + 1);
+            for (register WORD i = 0; i < pbid->NumberOfModuleForwarderRefs; ++i) {
+                if (!PlIsBoundModule(ctx, (const char*)pbidFirst + pbfr[i].OffsetModuleName, pbfr[i].TimeDateStamp))
+                    return LOGICAL_TRUE;
+            }
+        }
+    }
+    *pbValid = TRUE;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Fills rpe's IAT from dependencies on disk instead of the running system (like BindImage), every
+/// dependency is opened and indexed once per context. Imports are enumerated first if they aren't yet,
+/// nothing is rebound if PlValidateBoundImports finds the bound IAT still valid. The IAT of a protected
+/// image is made writable while it's filled and its protection restored afterwards </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT holding the bind cache </param>
+/// <param name="rpe">
+/// Loaded RAW_PE, normally an image (&vm->PE) </param>
+/// <param name="szSearchPath">
+/// ';' separated directories dependencies are looked for in </param>
+///
+/// <returns>
+/// LOGICAL_TRUE if every import was bound, LOGICAL_FALSE if some couldn't be (the rest are still bound),
+/// LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlBindImports(INOUT PEEL_CONTEXT* ctx, INOUT RAW_PE* rpe, IN LPCTSTR szSearchPath) {
+    BIND_MODULE    *pbm = NULL;
+    IMPORT_LIBRARY *pIL = NULL;
+    IMPORT_ITEM    *pII = NULL;
+    PTR             Address = 0,
+                    IatStart = 0,
+                    IatEnd = 0;
+    DWORD           dwProtect = 0;
+    BOOL            bBound = FALSE;
+    LOGICAL         lResult = LOGICAL_TRUE,
+                    lModule = LOGICAL_FALSE;
+
+    lModule = PlValidateBoundImports(ctx, rpe, &bBound);
+    if (!LOGICAL_SUCCESS(lModule))
+        return lModule;
+    // the IAT already holds the right addresses
+    if (bBound) {
+        dmsg(TEXT("\nBound imports of PE at 0x%p are still valid"), rpe->pDosHdr);
+        rpe->LoadStatus.Imported = TRUE;
+        return LOGICAL_TRUE;
+    }
+    for (pIL = rpe->pImport; pIL != NULL; pIL = (IMPORT_LIBRARY*)pIL->Flink) {
+        // delay loaded libraries are left to the delay load helper
+        if (pIL->Library == NULL || pIL->pDelayDesc != NULL)
+            continue;
+        lModule = PlGetBindModule(ctx, pIL->Library, szSearchPath, &pbm);
+        if (!LOGICAL_SUCCESS(lModule)) {
+            if (lModule == LOGICAL_MAYBE)
+                return LOGICAL_MAYBE;
+            lResult = LOGICAL_FALSE;
+            continue;
+        }
+        // a protected image's IAT is read only, open up this library's slots for the writes
+        if (rpe->LoadStatus.Protected) {
+            IatStart = (PTR)-1;
+            IatEnd = 0;
+            for (pII = pIL->iiImportList; pII != NULL && (pII->Name != NULL || pII->Ordinal != NULL); pII = (IMPORT_ITEM*)pII->Flink) {
+                if ((PTR)pII->dwItemPtr < IatStart)
+                    IatStart = (PTR)pII->dwItemPtr;
+                if ((PTR)pII->dwItemPtr + sizeof(PTR) > IatEnd)
+                    IatEnd = (PTR)pII->dwItemPtr + sizeof(PTR);
+            }
+            if (IatEnd == 0)
+                continue;
+            if (!VirtualProtect((LPVOID)IatStart, IatEnd - IatStart, PAGE_READWRITE, &dwProtect))
+                return LOGICAL_FALSE;
+        }
+        for (pII = pIL->iiImportList; pII != NULL; pII = (IMPORT_ITEM*)pII->Flink) {
+            if (pII->Name == NULL && pII->Ordinal == NULL)
+                break;
+            if (!LOGICAL_SUCCESS(PlResolveExport(ctx, pbm, pII->Name, pII->Name != NULL ? pII->Hint : (WORD)(PTR)pII->Ordinal, szSearchPath, &Address))) {
+                if (pII->Name != NULL)
+                    dmsg(TEXT("\nCould not bind %hs!%hs"), pIL->Library, pII->Name);
+                else
+                    dmsg(TEXT("\nCould not bind %hs!#%u"), pIL->Library, (unsigned int)(PTR)pII->Ordinal);
+                lResult = LOGICAL_FALSE;
+                continue;
+            }
+            // slots are pointer sized, dwItemPtr is just typed for PE32
+            *(PTR*)pII->dwItemPtr = Address;
+        }
+        if (rpe->LoadStatus.Protected && !VirtualProtect((LPVOID)IatStart, IatEnd - IatStart, dwProtect, &dwProtect))
+            return LOGICAL_FALSE;
+    }
+    if (LOGICAL_SUCCESS(lResult))
+        rpe->LoadStatus.Imported = TRUE;
+    return lResult;
+}
+
+/// <summary>
+///	Closes every dependency in a context's bind cache </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlFreeBindCache(INOUT PEEL_CONTEXT* ctx) {
+    BIND_MODULE *pbm = NULL,
+                *pbmNext = NULL;
+
+    EnterCriticalSection(&ctx->csLock);
+    pbm = ctx->pBindCache;
+    ctx->pBindCache = NULL;
+    LeaveCriticalSection(&ctx->csLock);
+    for (; pbm != NULL; pbm = pbmNext) {
+        pbmNext = (BIND_MODULE*)pbm->Flink;
+        PlFreeBindModule(pbm);
+    }
+    return LOGICAL_TRUE;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "peel.h"
+
+#pragma region Bind functions
+    // szSearchPath is a ';' separated list of directories
+    LOGICAL EXPORT LIBCALL PlGetBindModule(INOUT PEEL_CONTEXT* ctx, IN const char* szLibrary, IN LPCTSTR szSearchPath, OUT BIND_MODULE** ppbm);
+    LOGICAL EXPORT LIBCALL PlResolveExport(INOUT PEEL_CONTEXT* ctx, IN const BIND_MODULE* pbm, IN const char* szName, IN const WORD wHintOrdinal, IN LPCTSTR szSearchPath, OUT PTR* pAddress);
+    LOGICAL EXPORT LIBCALL PlValidateBoundImports(INOUT PEEL_CONTEXT* ctx, INOUT RAW_PE* rpe, OUT BOOL* pbValid);
+    LOGICAL EXPORT LIBCALL PlBindImports(INOUT PEEL_CONTEXT* ctx, INOUT RAW_PE* rpe, IN LPCTSTR szSearchPath);
+    LOGICAL EXPORT LIBCALL PlFreeBindCache(INOUT PEEL_CONTEXT* ctx);
+#pragma endregion
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "cave.h"
+#include "raw.h"
+
+#if SHED_CODECAVES
+
+#if USE_SIMD && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#   include <immintrin.h>
+#   define CAVE_SIMD TRUE
+#endif
+
+#define CAVE_FILL_INT3 0xcc     // msvc pads functions with int3, anything else pads with 0
+
+typedef size_t (*FIND_CAVE_BYTE)(const uint8_t* pData, size_t cbData);
+typedef size_t (*SKIP_BYTE)(const uint8_t* pData, size_t cbData, uint8_t bFill);
+
+/// <summary>
+///	Finds first byte that could start a cave (0x00 or 0xcc) </summary>
+///
+/// <returns>
+/// Index of byte, cbData if none </returns>
+static size_t PlFindCaveByteScalar(const uint8_t* pData, size_t cbData) {
+    size_t i = 0;
+
+    for (; i < cbData && pData[i] && pData[i] != CAVE_FILL_INT3; ++i)
+        ;
+    return i;
+}
+
+/// <summary>
+///	Finds first byte that isn't bFill, 8 bytes at a time </summary>
+///
+/// <returns>
+/// Index of byte, cbData if all of them are bFill </returns>
+static size_t PlSkipByteScalar(const uint8_t* pData, size_t cbData, uint8_t bFill) {
+    PTR64  qwFill = 0x0101010101010101ULL * bFill,
+           qwBlock = 0;
+    size_t i = 0;
+
+    for (; i + sizeof(qwBlock) <= cbData; i += sizeof(qwBlock)) {
+        memcpy(&qwBlock, pData + i, sizeof(qwBlock));
+        if (qwBlock != qwFill)
+            break;
+    }
+    for (; i < cbData && pData[i] == bFill; ++i)
+        ;
+    return i;
+}
+
+#if CAVE_SIMD
+// compare 16/32 bytes at once and turn the result into a bitmask, first set bit is the answer
+
+__attribute__((target("sse2")))
+static size_t PlFindCaveByteSse2(const uint8_t* pData, size_t cbData) {
+    const __m128i xZero = _mm_setzero_si128(),
+                  xInt3 = _mm_set1_epi8((char)CAVE_FILL_INT3);
+    size_t        i = 0;
+
+    for (; i + sizeof(__m128i) <= cbData; i += sizeof(__m128i)) {
+        __m128i      xBlock = _mm_loadu_si128((const __m128i*)(pData + i));
+        unsigned int uMask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(xBlock, xZero), _mm_cmpeq_epi8(xBlock, xInt3)));
+        if (uMask)
+            return i + __builtin_ctz(uMask);
+    }
+    return i + PlFindCaveByteScalar(pData + i, cbData - i);
+}
+
+__attribute__((target("sse2")))
+static size_t PlSkipByteSse2(const uint8_t* pData, size_t cbData, uint8_t bFill) {
+    const __m128i xFill = _mm_set1_epi8((char)bFill);
+    size_t        i = 0;
+
+    for (; i + sizeof(__m128i) <= cbData; i += sizeof(__m128i)) {
+        unsigned int uMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pData + i)), xFill));
+        if (uMask != 0xffff)
+            return i + __builtin_ctz(~uMask);
+    }
+    return i + PlSkipByteScalar(pData + i, cbData - i, bFill);
+}
+
+__attribute__((target("avx2")))
+static size_t PlFindCaveByteAvx2(const uint8_t* pData, size_t cbData) {
+    const __m256i yZero = _mm256_setzero_si256(),
+                  yInt3 = _mm256_set1_epi8((char)CAVE_FILL_INT3);
+    size_t        i = 0;
+
+    for (; i + sizeof(__m256i) <= cbData; i += sizeof(__m256i)) {
+        __m256i      yBlock = _mm256_loadu_si256((const __m256i*)(pData + i));
+        unsigned int uMask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(yBlock, yZero), _mm256_cmpeq_epi8(yBlock, yInt3)));
+        if (uMask)
+            return i + __builtin_ctz(uMask);
+    }
+    return i + PlFindCaveByteSse2(pData + i, cbData - i);
+}
+
+__attribute__((target("avx2")))
+static size_t PlSkipByteAvx2(const uint8_t* pData, size_t cbData, uint8_t bFill) {
+    const __m256i yFill = _mm256_set1_epi8((char)bFill);
+    size_t        i = 0;
+
+    // runs are usually long, so check two blocks per iteration before looking at the masks
+    for (; i + 2 * sizeof(__m256i) <= cbData; i += 2 * sizeof(__m256i)) {
+        __m256i yEq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(pData + i)), yFill),
+                yEq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(pData + i + sizeof(__m256i))), yFill);
+        if ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(yEq0, yEq1)) != 0xffffffff) {
+            unsigned int uMask = (unsigned int)_mm256_movemask_epi8(yEq0);
+            if (uMask != 0xffffffff)
+                return i + __builtin_ctz(~uMask);
+            return i + sizeof(__m256i) + __builtin_ctz(~(unsigned int)_mm256_movemask_epi8(yEq1));
+        }
+    }
+    return i + PlSkipByteSse2(pData + i, cbData - i, bFill);
+}
+#endif
+
+static FIND_CAVE_BYTE pfnFindCaveByte = NULL;
+static SKIP_BYTE      pfnSkipByte = NULL;
+
+/// <summary>
+///	Picks the widest scanning kernels the cpu supports (racing threads pick the same ones) </summary>
+static void PlSelectCaveKernels(void) {
+    if (pfnFindCaveByte != NULL)
+        return;
+#if CAVE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        pfnSkipByte = PlSkipByteAvx2;
+        pfnFindCaveByte = PlFindCaveByteAvx2;
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        pfnSkipByte = PlSkipByteSse2;
+        pfnFindCaveByte = PlFindCaveByteSse2;
+        return;
+    }
+#endif
+    pfnSkipByte = PlSkipByteScalar;
+    pfnFindCaveByte = PlFindCaveByteScalar;
+}
+
+/// <summary>
+///	Appends a cave to the list </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlAddCodecave(INOUT RAW_PE* rpe, INOUT CODECAVE_LIST** ppLast, IN const PTR Offset, IN const PTR Rva, IN const PTR Size, IN const PTR VirtualSize, IN const DWORD dwProtect, IN void* pData) {
+    CODECAVE_LIST *pCave = calloc(1, sizeof(CODECAVE_LIST));
+
+    if (pCave == NULL)
+        return LOGICAL_MAYBE;
+    pCave->Offset = Offset;
+    pCave->Rva = Rva;
+    pCave->Size = Size;
+    pCave->VirtualSize = VirtualSize;
+    pCave->Attributes = dwProtect;
+    pCave->Data = pData;
+    if (*ppLast == NULL)
+        rpe->pCaveData = pCave;
+    else
+        (*ppLast)->Flink = pCave;
+    *ppLast = pCave;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Scans a region of the file for runs of 0x00/0xcc. cbVirtual is how much of the region is
+/// mapped in the image, and bExtend means whatever the image has past cbRaw is padding too </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlScanCodecaves(INOUT RAW_PE* rpe, INOUT CODECAVE_LIST** ppLast, IN const uint8_t* pData, IN const PTR cbRaw, 
+                               IN const PTR Offset, IN const PTR Rva, IN const PTR cbVirtual, IN const BOOL bExtend, IN const DWORD dwProtect, IN const size_t cbMinimum) {
+    PTR  i = 0,
+         cbRun = 0,
+         cbRunVirtual = 0,
+         VirtualEnd = 0;
+    BOOL bReachedEnd = FALSE;
+
+    while (i < cbRaw) {
+        i += pfnFindCaveByte(pData + i, cbRaw - i);
+        if (i >= cbRaw)
+            break;
+        cbRun = pfnSkipByte(pData + i, cbRaw - i, pData[i]);
+        bReachedEnd = i + cbRun == cbRaw;
+        cbRunVirtual = 0;
+        if (i < cbVirtual) {
+            VirtualEnd = bReachedEnd && bExtend ? cbVirtual : (i + cbRun < cbVirtual ? i + cbRun : cbVirtual);
+            cbRunVirtual = VirtualEnd - i;
+        }
+        if (cbRun >= cbMinimum || cbRunVirtual >= cbMinimum) {
+            if (!LOGICAL_SUCCESS(PlAddCodecave(rpe, ppLast, Offset + i, cbRunVirtual ? Rva + i : 0, cbRun, cbRunVirtual, dwProtect, (void*)(pData + i))))
+                return LOGICAL_MAYBE;
+        }
+        i += cbRun;
+    }
+    // padding that only exists in the image
+    if (bExtend && !bReachedEnd && cbVirtual > cbRaw && cbVirtual - cbRaw >= cbMinimum) {
+        if (!LOGICAL_SUCCESS(PlAddCodecave(rpe, ppLast, 0, Rva + cbRaw, 0, cbVirtual - cbRaw, dwProtect, NULL)))
+            return LOGICAL_MAYBE;
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Finds codecaves (header slack, padding between sections and runs of 0x00/0xcc inside
+/// sections) and loads them into rpe->pCaveData </summary>
+///
+/// <param name="rpe">
+/// Loaded file aligned RAW_PE, image aligned ones (LoadStatus.Image) are refused </param>
+/// <param name="cbMinimum">
+/// Minimum size of a cave, 0 for MIN_CODECAVE_SIZE </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error or image aligned rpe, LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlEnumerateCodecaves(INOUT RAW_PE* rpe, IN const size_t cbMinimum) {
+    CODECAVE_LIST  *pLast = NULL;
+    SECTION_HEADER *pSection = NULL;
+    PTR             SizeofHeaders = 0,
+                    cbFile = 0,
+                    cbRaw = 0,
+                    cbVirtual = 0,
+                    GapStart = 0,
+                    GapEnd = 0;
+    size_t          cbMin = cbMinimum ? cbMinimum : MIN_CODECAVE_SIZE;
+    WORD            wNumSections = rpe->pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : rpe->pNtHdr->FileHeader.NumberOfSections;
+
+    // offsets below are file offsets
+    if (rpe->LoadStatus.Image)
+        return LOGICAL_FALSE;
+    if (rpe->pCaveData != NULL)
+        PlFreeEnumeratedCodecaves(rpe);
+    PlSelectCaveKernels();
+    // never read past the buffer when we know how big it is
+    if (!LOGICAL_SUCCESS(PlMaxPa(rpe, &cbFile)))
+        return LOGICAL_FALSE;
+    if (rpe->cbBuffer && rpe->cbBuffer < cbFile)
+        cbFile = rpe->cbBuffer;
+
+    // slack after section headers
+    PlSizeofPeHeaders(rpe, &SizeofHeaders);
+    cbRaw = rpe->pNtHdr->OptionalHeader.SizeOfHeaders < cbFile ? rpe->pNtHdr->OptionalHeader.SizeOfHeaders : cbFile;
+    if (cbRaw > SizeofHeaders) {
+        cbVirtual = PlAlignUp(rpe->pNtHdr->OptionalHeader.SizeOfHeaders, rpe->pNtHdr->OptionalHeader.SectionAlignment) - SizeofHeaders;
+        if (!LOGICAL_SUCCESS(PlScanCodecaves(rpe, &pLast, (uint8_t*)rpe->pDosHdr + SizeofHeaders, cbRaw - SizeofHeaders, SizeofHeaders, SizeofHeaders, cbVirtual, TRUE, PAGE_READONLY, cbMin)))
+            return LOGICAL_MAYBE;
+    }
+    for (register size_t i = 0; i < wNumSections; ++i) {
+        pSection = rpe->ppSecHdr[i];
+        // inside section (including the padding up to SizeOfRawData)
+        if (pSection->SizeOfRawData && pSection->PointerToRawData < cbFile) {
+            DWORD dwVirtualSize = pSection->Misc.VirtualSize ? pSection->Misc.VirtualSize : pSection->SizeOfRawData;
+
+            cbRaw = pSection->PointerToRawData + pSection->SizeOfRawData > cbFile ? cbFile - pSection->PointerToRawData : pSection->SizeOfRawData;
+            cbVirtual = PlAlignUp(dwVirtualSize, rpe->pNtHdr->OptionalHeader.SectionAlignment);
+            // past raw data is uninitialized data unless the raw data already covers VirtualSize
+            if (!LOGICAL_SUCCESS(PlScanCodecaves(rpe, &pLast, (uint8_t*)rpe->ppSectionData[i], cbRaw, pSection->PointerToRawData, pSection->VirtualAddress,
+                                                 cbVirtual, cbRaw >= dwVirtualSize, PlSectionToPageProtection(pSection->Characteristics), cbMin)))
+                return LOGICAL_MAYBE;
+        }
+        // file padding between this section and the next one, not mapped
+        GapStart = pSection->PointerToRawData + pSection->SizeOfRawData;
+        GapEnd = cbFile;
+        for (register size_t k = 0; k < wNumSections; ++k) {
+            if (rpe->ppSecHdr[k]->SizeOfRawData && rpe->ppSecHdr[k]->PointerToRawData >= GapStart && rpe->ppSecHdr[k]->PointerToRawData < GapEnd)
+                GapEnd = rpe->ppSecHdr[k]->PointerToRawData;
+        }
+        if (pSection->SizeOfRawData && GapEnd > GapStart && GapEnd != cbFile) {
+            if (!LOGICAL_SUCCESS(PlScanCodecaves(rpe, &pLast, (uint8_t*)rpe->pDosHdr + GapStart, GapEnd - GapStart, GapStart, 0, 0, FALSE, PAGE_NOACCESS, cbMin)))
+                return LOGICAL_MAYBE;
+        }
+    }
+    dmsg(TEXT("\nEnumerated codecaves of PE file at 0x%p"), rpe->pDosHdr);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Frees codecave list in rpe->pCaveData </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlFreeEnumeratedCodecaves(INOUT RAW_PE* rpe) {
+    CODECAVE_LIST *pCave = NULL,
+                  *pCaveNext = NULL;
+
+    if (rpe->pCaveData == NULL)
+        return LOGICAL_FALSE;
+    for (pCave = rpe->pCaveData; pCave != NULL; pCave = pCaveNext) {
+        pCaveNext = (CODECAVE_LIST*)pCave->Flink;
+        free(pCave);
+    }
+    rpe->pCaveData = NULL;
+    return LOGICAL_TRUE;
+}
+
+#endif
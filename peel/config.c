@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+/// <summary>
+///	Copies the load config directory, fields past its Size (older linkers) read as 0 </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE, file or image (&vm->PE) </param>
+/// <param name="plcd">
+/// Receives the directory </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there is no load config directory or it points outside of the PE </returns>
+LOGICAL EXPORT LIBCALL PlGetLoadConfig(IN const RAW_PE* rpe, OUT LOAD_CONFIG_DIRECTORY* plcd) {
+    LOAD_CONFIG_DIRECTORY *plcdImage = NULL;
+    BYTE                  *pLast = NULL;
+    DWORD                  Rva = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG].VirtualAddress,
+                           cbCopy = 0;
+
+    memset(plcd, 0, sizeof(*plcd));
+    if (!Rva || !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG].Size)
+        return LOGICAL_FALSE;
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva, (PTR*)&plcdImage)))
+        return LOGICAL_FALSE;
+    // the directory's own Size wins, the data directory's was wrong for years
+    cbCopy = plcdImage->Size < sizeof(*plcd) ? plcdImage->Size : sizeof(*plcd);
+    if (cbCopy < sizeof(DWORD))
+        return LOGICAL_FALSE;
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva + cbCopy - 1, (PTR*)&pLast))
+     || pLast - (BYTE*)plcdImage != cbCopy - 1)
+        return LOGICAL_FALSE;
+    memcpy(plcd, plcdImage, cbCopy);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Expands GuardCFFunctionTable into a bitmap over the image, so checking a call target is a single bit test.
+/// Like the loader's, a 16 byte slot has 2 bits, one for a target at its start and one if any target in it
+/// is unaligned (the whole slot is valid then). Suppressed targets aren't set. GuardCFFunctionTable is a VA,
+/// so rpe's ImageBase has to be the base its contents are relocated for </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE, file or image (&vm->PE) </param>
+/// <param name="pgcb">
+/// Receives bitmap </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if the image isn't instrumented or the table points outside of the PE,
+/// LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlGetGuardCFBitmap(IN const RAW_PE* rpe, OUT GUARD_CF_BITMAP* pgcb) {
+    LOAD_CONFIG_DIRECTORY lcd;
+    BYTE   *pTable = NULL,
+           *pLast = NULL;
+    DWORD   TableRva = 0,
+            Rva = 0,
+            cbImage = rpe->pNtHdr->OptionalHeader.SizeOfImage,
+            dwSlot = 0;
+    size_t  cbStride = 0,
+            cEntries = 0,
+            i = 0;
+
+    memset(pgcb, 0, sizeof(*pgcb));
+    if (!LOGICAL_SUCCESS(PlGetLoadConfig(rpe, &lcd)))
+        return LOGICAL_FALSE;
+    if (!(lcd.GuardFlags & GUARD_CF_INSTRUMENTED) || !lcd.GuardCFFunctionTable || !lcd.GuardCFFunctionCount)
+        return LOGICAL_FALSE;
+    cbStride = sizeof(DWORD) + ((lcd.GuardFlags & GUARD_CF_STRIDE_MASK) >> GUARD_CF_STRIDE_SHIFT);
+    cEntries = (size_t)lcd.GuardCFFunctionCount;
+    if (lcd.GuardCFFunctionTable < rpe->pNtHdr->OptionalHeader.ImageBase
+     || lcd.GuardCFFunctionTable - rpe->pNtHdr->OptionalHeader.ImageBase >= cbImage
+     || cEntries > cbImage / cbStride)
+        return LOGICAL_FALSE;
+    TableRva = (DWORD)(lcd.GuardCFFunctionTable - rpe->pNtHdr->OptionalHeader.ImageBase);
+    // whole table has to be in one section
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, TableRva, (PTR*)&pTable))
+     || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, TableRva + (DWORD)(cEntries * cbStride) - 1, (PTR*)&pLast))
+     || pLast - pTable != cEntries * cbStride - 1)
+        return LOGICAL_FALSE;
+    pgcb->pBits = (BYTE*)calloc(((cbImage + 0x3f) >> 6), sizeof(BYTE));
+    if (pgcb->pBits == NULL)
+        return LOGICAL_MAYBE;
+    pgcb->cbImage = cbImage;
+    for (i = 0; i < cEntries; ++i, pTable += cbStride) {
+        Rva = *(DWORD*)pTable;
+        if (cbStride > sizeof(DWORD) && pTable[sizeof(DWORD)] & (GUARD_FLAG_FID_SUPPRESSED | GUARD_FLAG_EXPORT_SUPPRESSED))
+            continue;
+        if (Rva >= cbImage) {
+            dmsg(TEXT("\nGuard CF target %08x is outside of image"), Rva);
+            continue;
+        }
+        dwSlot = Rva >> 4;
+        pgcb->pBits[dwSlot >> 2] |= (Rva & 0x0f ? 2 : 1) << ((dwSlot & 3) << 1);
+        ++pgcb->cTargets;
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Checks whether an rva is a valid indirect call target </summary>
+///
+/// <param name="pgcb">
+/// Pointer to GUARD_CF_BITMAP from PlGetGuardCFBitmap </param>
+/// <param name="Rva">
+/// Rva of call target </param>
+///
+/// <returns>
+/// LOGICAL_TRUE if it is valid, LOGICAL_FALSE if it isn't </returns>
+LOGICAL EXPORT LIBCALL PlIsGuardCFTarget(IN const GUARD_CF_BITMAP* pgcb, IN const DWORD Rva) {
+    DWORD dwSlot = Rva >> 4,
+          dwBits = 0;
+
+    if (Rva >= pgcb->cbImage)
+        return LOGICAL_FALSE;
+    dwBits = (pgcb->pBits[dwSlot >> 2] >> ((dwSlot & 3) << 1)) & 3;
+    // aligned targets may use either bit, others need the whole slot
+    return (Rva & 0x0f ? dwBits & 2 : dwBits) ? LOGICAL_TRUE : LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Frees a guard CF bitmap </summary>
+///
+/// <param name="pgcb">
+/// Pointer to GUARD_CF_BITMAP from PlGetGuardCFBitmap </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlFreeGuardCFBitmap(INOUT GUARD_CF_BITMAP* pgcb) {
+    if (pgcb->pBits != NULL)
+        free(pgcb->pBits);
+    memset(pgcb, 0, sizeof(*pgcb));
+    return LOGICAL_TRUE;
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "context.h"
+
+/// <summary>
+///	Finds the size class a buffer of cbSize bytes belongs to </summary>
+///
+/// <returns>
+/// Class index, POOL_CLASSES if too big to pool </returns>
+static size_t PlPoolClass(IN const size_t cbSize) {
+    size_t iClass = 0;
+
+    while (iClass < POOL_CLASSES && ((size_t)POOL_MIN_CLASS << iClass) < cbSize)
+        ++iClass;
+    return iClass;
+}
+
+/// <summary>
+///	Reserves cbReserve bytes of fresh pages and commits the first cbCommit of them, using large pages (always
+/// committed whole) if ctx has them enabled and the buffer is big enough to benefit </summary>
+///
+/// <returns>
+/// Buffer or NULL, release with VirtualFree either way </returns>
+static void* PlAllocBuffer(IN const PEEL_CONTEXT* ctx, IN const size_t cbReserve, IN const size_t cbCommit) {
+    void   *pBuffer = NULL;
+#if LARGE_PAGE_IMAGES
+    size_t  cbAligned = 0;
+
+    if (ctx != NULL && ctx->cbLargePage && cbReserve >= LARGE_PAGE_THRESHOLD) {
+        cbAligned = (cbReserve + ctx->cbLargePage - 1) & ~(ctx->cbLargePage - 1);
+        // large pages can't be write watched, snapshots of these fall back to comparing pages
+        pBuffer = VirtualAlloc(NULL, cbAligned, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (pBuffer != NULL)
+            return pBuffer;
+        // physical memory too fragmented for contiguous large pages
+        dmsg(TEXT("\nLarge page allocation of 0x%p bytes failed, using normal pages"), (void*)cbAligned);
+    }
+#endif
+    if (cbCommit >= cbReserve)
+        return VirtualAlloc(NULL, cbReserve, IMAGE_ALLOC_TYPE, PAGE_READWRITE);
+    // write watching has to be asked for when reserving
+    pBuffer = VirtualAlloc(NULL, cbReserve, IMAGE_ALLOC_TYPE & ~MEM_COMMIT, PAGE_READWRITE);
+    if (pBuffer != NULL && VirtualAlloc(pBuffer, cbCommit, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+        VirtualFree(pBuffer, 0, MEM_RELEASE);
+        pBuffer = NULL;
+    }
+    return pBuffer;
+}
+
+/// <summary>
+///	Initializes a context </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT to initialize </param>
+/// <param name="cbPoolMax">
+/// Most bytes of free buffers to keep around, 0 for POOL_DEFAULT_MAX </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlCreateContext(OUT PEEL_CONTEXT* ctx, IN const size_t cbPoolMax) {
+    memset(ctx, 0, sizeof(*ctx));
+    InitializeCriticalSection(&ctx->csLock);
+    ctx->cbPoolMax = cbPoolMax ? cbPoolMax : POOL_DEFAULT_MAX;
+    dmsg(TEXT("\nCreated context at 0x%p"), ctx);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Releases everything a context holds. Anything still using the context has to be freed first </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+///
+/// <returns>
+/// LOGICAL_TRUE, *ctx is zeroed </returns>
+LOGICAL EXPORT LIBCALL PlDestroyContext(INOUT PEEL_CONTEXT* ctx) {
+    PlFreeTemplates(ctx);
+    PlFreeBindCache(ctx);
+    PlFreeRegistry(ctx);
+    PlTrimPool(ctx, TRUE);
+    DeleteCriticalSection(&ctx->csLock);
+    memset(ctx, 0, sizeof(*ctx));
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Lets buffers of LARGE_PAGE_THRESHOLD bytes or more come from large pages, which cuts TLB misses when
+/// walking big images. Enables SeLockMemoryPrivilege for the process, the account must already hold it </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if large pages are unsupported or the privilege isn't held, 
+/// buffers keep using normal pages either way </returns>
+LOGICAL EXPORT LIBCALL PlEnableLargePages(INOUT PEEL_CONTEXT* ctx) {
+#if LARGE_PAGE_IMAGES
+    HANDLE           hToken = NULL;
+    TOKEN_PRIVILEGES tp;
+    size_t           cbLargePage = GetLargePageMinimum();
+    BOOL             bEnabled = FALSE;
+
+    if (!cbLargePage)
+        return LOGICAL_FALSE;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+        return LOGICAL_FALSE;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    // AdjustTokenPrivileges succeeds even if nothing was assigned
+    bEnabled = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+            && AdjustTokenPrivileges(hToken, FALSE, &tp, 0, NULL, NULL)
+            && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(hToken);
+    if (!bEnabled)
+        return LOGICAL_FALSE;
+    ctx->cbLargePage = cbLargePage;
+    dmsg(TEXT("\nLarge pages of 0x%p bytes enabled for context at 0x%p"), (void*)cbLargePage, ctx);
+    return LOGICAL_TRUE;
+#else
+    return LOGICAL_FALSE;
+#endif
+}
+
+/// <summary>
+///	Gets a zeroed, PAGE_READWRITE buffer of at least cbSize bytes, reusing a pooled one of the same size
+/// class if there is one. Only cbSize bytes are committed, the rest of the class is reserved for reuse </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT, NULL to always VirtualAlloc normal pages </param>
+/// <param name="cbSize">
+/// Minimum size of buffer </param>
+/// <param name="ppBuffer">
+/// Pointer that will recieve buffer, release with PlPoolFree and the same cbSize </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on memory error </returns>
+LOGICAL EXPORT LIBCALL PlPoolAlloc(INOUT PEEL_CONTEXT* ctx, IN const size_t cbSize, OUT void** ppBuffer) {
+    POOL_BUFFER *pEntry = NULL;
+    size_t       iClass = PlPoolClass(cbSize),
+                 cbCommitted = 0;
+
+    *ppBuffer = NULL;
+    if (ctx != NULL && iClass < POOL_CLASSES) {
+        EnterCriticalSection(&ctx->csLock);
+        pEntry = ctx->pPool[iClass];
+        if (pEntry != NULL) {
+            ctx->pPool[iClass] = (POOL_BUFFER*)pEntry->Flink;
+            ctx->cbPooled -= pEntry->cbCommitted;
+        }
+        LeaveCriticalSection(&ctx->csLock);
+        if (pEntry != NULL) {
+            *ppBuffer = pEntry->pBuffer;
+            cbCommitted = pEntry->cbCommitted;
+            free(pEntry);
+            // a bigger request than last time commits the difference, those pages come zeroed
+            if (cbSize > cbCommitted && VirtualAlloc(*ppBuffer, cbSize, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+                VirtualFree(*ppBuffer, 0, MEM_RELEASE);
+                *ppBuffer = NULL;
+                return LOGICAL_MAYBE;
+            }
+            // pages that were committed are most likely resident, clearing them beats faulting fresh ones
+            memset(*ppBuffer, 0, cbSize < cbCommitted ? cbSize : cbCommitted);
+            return LOGICAL_TRUE;
+        }
+        // reserve the whole class so the buffer can be reused for anything else in it, commit only what is needed
+        *ppBuffer = PlAllocBuffer(ctx, (size_t)POOL_MIN_CLASS << iClass, cbSize);
+    } else
+        *ppBuffer = PlAllocBuffer(ctx, cbSize, cbSize);
+    return *ppBuffer != NULL ? LOGICAL_TRUE : LOGICAL_MAYBE;
+}
+
+/// <summary>
+///	Returns a buffer from PlPoolAlloc. Buffers are released instead of pooled once the pool is full </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT buffer was allocated with (can be NULL) </param>
+/// <param name="pBuffer">
+/// Buffer from PlPoolAlloc </param>
+/// <param name="cbSize">
+/// cbSize passed to PlPoolAlloc </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on memory error (buffer is released) </returns>
+LOGICAL EXPORT LIBCALL PlPoolFree(INOUT PEEL_CONTEXT* ctx, IN void* pBuffer, IN const size_t cbSize) {
+    SYSTEM_INFO  si;
+    POOL_BUFFER *pEntry = NULL;
+    size_t       iClass = PlPoolClass(cbSize),
+                 cbClass = 0,
+                 cbCommitted = 0;
+
+    if (ctx == NULL || iClass >= POOL_CLASSES) {
+        VirtualFree(pBuffer, 0, MEM_RELEASE);
+        return LOGICAL_TRUE;
+    }
+    GetSystemInfo(&si);
+    cbClass = (size_t)POOL_MIN_CLASS << iClass;
+    cbCommitted = (cbSize + si.dwPageSize - 1) & ~((size_t)si.dwPageSize - 1);
+    // don't bother decommitting a buffer that is going to be released anyway
+    EnterCriticalSection(&ctx->csLock);
+    if (ctx->cbPooled + cbCommitted > ctx->cbPoolMax) {
+        LeaveCriticalSection(&ctx->csLock);
+        VirtualFree(pBuffer, 0, MEM_RELEASE);
+        return LOGICAL_TRUE;
+    }
+    LeaveCriticalSection(&ctx->csLock);
+    // whatever an earlier, bigger user committed past cbSize goes back (large pages can't be decommitted)
+    if (cbCommitted < cbClass && !VirtualFree((void*)((PTR)pBuffer + cbCommitted), cbClass - cbCommitted, MEM_DECOMMIT))
+        cbCommitted = cbClass;
+    pEntry = malloc(sizeof(*pEntry));
+    if (pEntry == NULL) {
+        VirtualFree(pBuffer, 0, MEM_RELEASE);
+        return LOGICAL_MAYBE;
+    }
+    pEntry->pBuffer = pBuffer;
+    pEntry->cbCommitted = cbCommitted;
+    EnterCriticalSection(&ctx->csLock);
+    if (ctx->cbPooled + cbCommitted > ctx->cbPoolMax) {
+        LeaveCriticalSection(&ctx->csLock);
+        free(pEntry);
+        VirtualFree(pBuffer, 0, MEM_RELEASE);
+        return LOGICAL_TRUE;
+    }
+    pEntry->Flink = ctx->pPool[iClass];
+    ctx->pPool[iClass] = pEntry;
+    ctx->cbPooled += cbCommitted;
+    LeaveCriticalSection(&ctx->csLock);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Puts cBuffers buffers big enough for cbSize in the pool, with every page already faulted in </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="cbSize">
+/// Size of images that will be loaded </param>
+/// <param name="cBuffers">
+/// Number of buffers to add </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if cbSize is too big to pool, LOGICAL_MAYBE on memory error </returns>
+LOGICAL EXPORT LIBCALL PlPrefillPool(INOUT PEEL_CONTEXT* ctx, IN const size_t cbSize, IN const size_t cBuffers) {
+    SYSTEM_INFO si;
+    size_t      iClass = PlPoolClass(cbSize),
+                cbClass = 0;
+    void       *pBuffer = NULL;
+
+    if (iClass >= POOL_CLASSES)
+        return LOGICAL_FALSE;
+    GetSystemInfo(&si);
+    cbClass = (size_t)POOL_MIN_CLASS << iClass;
+    for (register size_t i = 0; i < cBuffers; ++i) {
+        pBuffer = PlAllocBuffer(ctx, cbClass, cbClass);
+        if (pBuffer == NULL)
+            return LOGICAL_MAYBE;
+        for (register size_t k = 0; k < cbClass; k += si.dwPageSize)
+            ((volatile uint8_t*)pBuffer)[k] = 0;
+        if (!LOGICAL_SUCCESS(PlPoolFree(ctx, pBuffer, cbClass)))
+            return LOGICAL_MAYBE;
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Gives pooled memory back to the system, either by releasing the buffers or by letting the system
+/// discard their contents (MEM_RESET) while keeping them pooled </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="bRelease">
+/// TRUE to release every pooled buffer, FALSE to only reset them </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlTrimPool(INOUT PEEL_CONTEXT* ctx, IN const BOOL bRelease) {
+    POOL_BUFFER *pEntry = NULL,
+                *pEntryNext = NULL;
+
+    EnterCriticalSection(&ctx->csLock);
+    for (register size_t i = 0; i < POOL_CLASSES; ++i) {
+        for (pEntry = ctx->pPool[i]; pEntry != NULL; pEntry = pEntryNext) {
+            pEntryNext = (POOL_BUFFER*)pEntry->Flink;
+            if (bRelease) {
+                VirtualFree(pEntry->pBuffer, 0, MEM_RELEASE);
+                free(pEntry);
+            } else
+                VirtualAlloc(pEntry->pBuffer, pEntry->cbCommitted, MEM_RESET, PAGE_READWRITE);
+        }
+        if (bRelease)
+            ctx->pPool[i] = NULL;
+    }
+    if (bRelease)
+        ctx->cbPooled = 0;
+    LeaveCriticalSection(&ctx->csLock);
+    return LOGICAL_TRUE;
+}
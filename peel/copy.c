@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "copy.h"
+
+#if USE_SIMD && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#   include <immintrin.h>
+#   define COPY_SIMD TRUE
+#endif
+
+typedef void (*STREAM_COPY)(uint8_t* pDest, const uint8_t* pSource, size_t cbSize);
+
+typedef struct _COPY_CHUNK {
+    uint8_t       *pDest;
+    const uint8_t *pSource;
+    size_t         cbSize;
+} COPY_CHUNK;
+
+/// <summary>
+///	Plain copy, the compiler's memmove is as good as it gets for anything that fits in cache </summary>
+static void PlStreamCopyScalar(uint8_t* pDest, const uint8_t* pSource, size_t cbSize) {
+    memmove(pDest, pSource, cbSize);
+}
+
+#if COPY_SIMD
+/// <summary>
+///	Copies with non-temporal stores so the destination doesn't evict the caller's working set,
+/// 64 bytes (a cache line) per iteration </summary>
+__attribute__((target("sse2")))
+static void PlStreamCopySse2(uint8_t* pDest, const uint8_t* pSource, size_t cbSize) {
+    size_t cbHead = (size_t)(-(PTR)pDest & (sizeof(__m128i) - 1)),
+           i = 0;
+
+    // streaming stores need an aligned destination
+    if (cbHead > cbSize)
+        cbHead = cbSize;
+    memmove(pDest, pSource, cbHead);
+    pDest += cbHead;
+    pSource += cbHead;
+    cbSize -= cbHead;
+    for (; i + 4 * sizeof(__m128i) <= cbSize; i += 4 * sizeof(__m128i)) {
+        __m128i x0 = _mm_loadu_si128((const __m128i*)(pSource + i)),
+                x1 = _mm_loadu_si128((const __m128i*)(pSource + i + 0x10)),
+                x2 = _mm_loadu_si128((const __m128i*)(pSource + i + 0x20)),
+                x3 = _mm_loadu_si128((const __m128i*)(pSource + i + 0x30));
+        _mm_stream_si128((__m128i*)(pDest + i), x0);
+        _mm_stream_si128((__m128i*)(pDest + i + 0x10), x1);
+        _mm_stream_si128((__m128i*)(pDest + i + 0x20), x2);
+        _mm_stream_si128((__m128i*)(pDest + i + 0x30), x3);
+    }
+    // make the stores visible before anyone reads the copy
+    _mm_sfence();
+    memmove(pDest + i, pSource + i, cbSize - i);
+}
+#endif
+
+static STREAM_COPY pfnStreamCopy = NULL;
+
+/// <summary>
+///	Picks the streaming copy the cpu supports (racing threads pick the same one) </summary>
+static void PlSelectCopyKernel(void) {
+    if (pfnStreamCopy != NULL)
+        return;
+#if COPY_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        pfnStreamCopy = PlStreamCopySse2;
+        return;
+    }
+#endif
+    pfnStreamCopy = PlStreamCopyScalar;
+}
+
+/// <summary>
+///	Copies one chunk of a split copy </summary>
+static DWORD WINAPI PlCopyThread(LPVOID lpChunk) {
+    COPY_CHUNK *pChunk = (COPY_CHUNK*)lpChunk;
+
+    pfnStreamCopy(pChunk->pDest, pChunk->pSource, pChunk->cbSize);
+    return 0;
+}
+
+/// <summary>
+///	Copies memory, bypassing the cache for copies of STREAM_COPY_THRESHOLD bytes or more and splitting
+/// copies of PARALLEL_COPY_THRESHOLD bytes or more across up to COPY_THREADS threads </summary>
+///
+/// <param name="pDest">
+/// Destination buffer </param>
+/// <param name="pSource">
+/// Source buffer, may overlap pDest (copy is done with memmove then) </param>
+/// <param name="cbSize">
+/// cb to copy </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlCopyMemory(OUT void* pDest, IN const void* pSource, IN const size_t cbSize) {
+    COPY_CHUNK ccChunks[COPY_THREADS];
+    HANDLE     hThreads[COPY_THREADS];
+    size_t     cChunks = 1,
+               cbChunk = 0,
+               cThreads = 0;
+
+    if (cbSize < STREAM_COPY_THRESHOLD
+     || ((PTR)pDest < (PTR)pSource + cbSize && (PTR)pSource < (PTR)pDest + cbSize)) {
+        memmove(pDest, pSource, cbSize);
+        return LOGICAL_TRUE;
+    }
+    PlSelectCopyKernel();
+    if (cbSize >= PARALLEL_COPY_THRESHOLD)
+        cChunks = COPY_THREADS;
+    // chunks start on page boundaries so threads never share a line
+    cbChunk = (cbSize / cChunks + 0xfff) & ~(size_t)0xfff;
+    for (register size_t i = 0; i < cChunks; ++i) {
+        ccChunks[i].pDest = (uint8_t*)pDest + i * cbChunk;
+        ccChunks[i].pSource = (const uint8_t*)pSource + i * cbChunk;
+        ccChunks[i].cbSize = i + 1 < cChunks ? cbChunk : cbSize - i * cbChunk;
+    }
+    // chunk 0 is copied on this thread, so are chunks a thread couldn't be created for
+    for (register size_t i = 1; i < cChunks; ++i) {
+        hThreads[cThreads] = CreateThread(NULL, 0, PlCopyThread, &ccChunks[i], 0, NULL);
+        if (hThreads[cThreads] != NULL)
+            ++cThreads;
+        else
+            PlCopyThread(&ccChunks[i]);
+    }
+    PlCopyThread(&ccChunks[0]);
+    if (cThreads) {
+        WaitForMultipleObjects((DWORD)cThreads, hThreads, TRUE, INFINITE);
+        for (register size_t i = 0; i < cThreads; ++i)
+            CloseHandle(hThreads[i]);
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Zeroes the parts of a buffer no range covers, so conversions into caller buffers don't clear
+/// memory they are about to overwrite anyway </summary>
+///
+/// <param name="pBuffer">
+/// Buffer ranges are relative to </param>
+/// <param name="cbBuffer">
+/// cb of buffer, anything past the last range is zeroed up to here </param>
+/// <param name="pRanges">
+/// Array of ranges that were written, sorted by Offset on return </param>
+/// <param name="cRanges">
+/// Number of ranges </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlZeroGaps(INOUT void* pBuffer, IN const size_t cbBuffer, INOUT COPY_RANGE* pRanges, IN const size_t cRanges) {
+    COPY_RANGE crKey;
+    PTR        Cursor = 0,
+               End = 0;
+
+    // there's a range per section at most, insertion sort is fine (and sections are usually in order)
+    for (register size_t i = 1; i < cRanges; ++i) {
+        register size_t k = i;
+
+        crKey = pRanges[i];
+        for (; k > 0 && pRanges[k - 1].Offset > crKey.Offset; --k)
+            pRanges[k] = pRanges[k - 1];
+        pRanges[k] = crKey;
+    }
+    for (register size_t i = 0; i < cRanges && Cursor < cbBuffer; ++i) {
+        if (pRanges[i].Offset > Cursor)
+            memset((void*)((PTR)pBuffer + Cursor), 0, (pRanges[i].Offset < cbBuffer ? pRanges[i].Offset : cbBuffer) - Cursor);
+        End = pRanges[i].Offset + pRanges[i].cbSize;
+        if (End > Cursor)
+            Cursor = End;
+    }
+    if (Cursor < cbBuffer)
+        memset((void*)((PTR)pBuffer + Cursor), 0, cbBuffer - Cursor);
+    return LOGICAL_TRUE;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "except.h"
+
+/// <summary>
+///	Orders function entries by BeginAddress </summary>
+static int PlCompareFunctionEntries(IN const void* pA, IN const void* pB) {
+    DWORD dwA = ((const FUNCTION_ENTRY*)pA)->BeginAddress,
+          dwB = ((const FUNCTION_ENTRY*)pB)->BeginAddress;
+
+    return dwA < dwB ? -1 : dwA > dwB;
+}
+
+/// <summary>
+///	Finds the first entry in [iLo, iHi) starting after Rva </summary>
+static size_t PlUpperBoundFunction(IN const FUNCTION_ENTRY* pEntries, IN size_t iLo, IN size_t iHi, IN const DWORD Rva) {
+    size_t iMid = 0;
+
+    while (iLo < iHi) {
+        iMid = iLo + (iHi - iLo) / 2;
+        if (pEntries[iMid].BeginAddress <= Rva)
+            iLo = iMid + 1;
+        else
+            iHi = iMid;
+    }
+    return iLo;
+}
+
+/// <summary>
+///	Resolves and validates the exception directory (.pdata) of a PE32+ image once, so lookups
+/// don't have to. Tables that aren't sorted by BeginAddress are sorted into an owned copy </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE, file or image (&vm->PE) </param>
+/// <param name="pft">
+/// Receives the table, entries point into rpe unless pOwned is set </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there is no exception directory or it is malformed (entries outside
+/// of the image or overlapping), LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlGetFunctionTable(IN const RAW_PE* rpe, OUT FUNCTION_TABLE* pft) {
+    FUNCTION_ENTRY *pEntries = NULL,
+                   *pLast = NULL;
+    DWORD           Rva = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION].VirtualAddress,
+                    cbTable = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION].Size;
+    size_t          cEntries = cbTable / sizeof(FUNCTION_ENTRY),
+                    i = 0;
+    BOOL            bSorted = TRUE;
+
+    memset(pft, 0, sizeof(*pft));
+    if (!Rva || !cEntries)
+        return LOGICAL_FALSE;
+    // whole table has to be in one section
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva, (PTR*)&pEntries))
+     || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva + cEntries * sizeof(FUNCTION_ENTRY) - 1, (PTR*)&pLast))
+     || (BYTE*)pLast - (BYTE*)pEntries != cEntries * sizeof(FUNCTION_ENTRY) - 1)
+        return LOGICAL_FALSE;
+    for (i = 0; i < cEntries; ++i) {
+        if (pEntries[i].BeginAddress >= pEntries[i].EndAddress
+         || pEntries[i].EndAddress > rpe->pNtHdr->OptionalHeader.SizeOfImage) {
+            dmsg(TEXT("\nFunction entry %u [%08x, %08x) is invalid"), (DWORD)i, pEntries[i].BeginAddress, pEntries[i].EndAddress);
+            return LOGICAL_FALSE;
+        }
+        if (i && pEntries[i - 1].BeginAddress > pEntries[i].BeginAddress)
+            bSorted = FALSE;
+    }
+    if (!bSorted) {
+        dmsg(TEXT("\nException directory isn't sorted, sorting a copy of %u entries"), (DWORD)cEntries);
+        pft->pOwned = (FUNCTION_ENTRY*)malloc(cEntries * sizeof(FUNCTION_ENTRY));
+        if (pft->pOwned == NULL)
+            return LOGICAL_MAYBE;
+        memcpy(pft->pOwned, pEntries, cEntries * sizeof(FUNCTION_ENTRY));
+        qsort(pft->pOwned, cEntries, sizeof(FUNCTION_ENTRY), PlCompareFunctionEntries);
+        pEntries = pft->pOwned;
+    }
+    // binary search relies on disjoint ranges
+    for (i = 1; i < cEntries; ++i) {
+        if (pEntries[i - 1].EndAddress > pEntries[i].BeginAddress) {
+            dmsg(TEXT("\nFunction entries %u and %u overlap"), (DWORD)i - 1, (DWORD)i);
+            PlFreeFunctionTable(pft);
+            return LOGICAL_FALSE;
+        }
+    }
+    pft->pEntries = pEntries;
+    pft->cEntries = cEntries;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Frees the sorted copy of a function table, if there is one </summary>
+///
+/// <param name="pft">
+/// Pointer to FUNCTION_TABLE from PlGetFunctionTable </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlFreeFunctionTable(INOUT FUNCTION_TABLE* pft) {
+    if (pft->pOwned != NULL)
+        free(pft->pOwned);
+    memset(pft, 0, sizeof(*pft));
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Finds the function entry containing an rva </summary>
+///
+/// <param name="pft">
+/// Pointer to FUNCTION_TABLE from PlGetFunctionTable </param>
+/// <param name="Rva">
+/// Rva to look up </param>
+/// <param name="ppfe">
+/// Receives entry, NULL if there is none </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if no function contains Rva (leaf functions have no entry) </returns>
+LOGICAL EXPORT LIBCALL PlLookupFunctionEntry(IN const FUNCTION_TABLE* pft, IN const DWORD Rva, OUT const FUNCTION_ENTRY** ppfe) {
+    size_t i = PlUpperBoundFunction(pft->pEntries, 0, pft->cEntries, Rva);
+
+    *ppfe = NULL;
+    if (!i || Rva >= pft->pEntries[i - 1].EndAddress)
+        return LOGICAL_FALSE;
+    *ppfe = &pft->pEntries[i - 1];
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Looks up a batch of rvas. Each search gallops forward from the previous hit, so sorted
+/// batches (stack walks, profiler samples) only touch the part of the table between them </summary>
+///
+/// <param name="pft">
+/// Pointer to FUNCTION_TABLE from PlGetFunctionTable </param>
+/// <param name="pRvas">
+/// Rvas to look up, any order but ascending is fastest </param>
+/// <param name="cRvas">
+/// Count of pRvas </param>
+/// <param name="ppfe">
+/// Receives cRvas entries, NULL where no function contains the rva </param>
+///
+/// <returns>
+/// LOGICAL_TRUE if every rva was found, LOGICAL_FALSE if any wasn't </returns>
+LOGICAL EXPORT LIBCALL PlLookupFunctionEntries(IN const FUNCTION_TABLE* pft, IN const DWORD* pRvas, IN const size_t cRvas, OUT const FUNCTION_ENTRY** ppfe) {
+    LOGICAL lResult = LOGICAL_TRUE;
+    size_t  iLo = 0,
+            iHi = 0,
+            cStep = 0,
+            i = 0,
+            j = 0;
+
+    for (i = 0; i < cRvas; ++i) {
+        ppfe[i] = NULL;
+        // restart from the front when the stream goes backwards
+        if (iLo >= pft->cEntries || pRvas[i] < pft->pEntries[iLo].BeginAddress)
+            iLo = 0;
+        iHi = iLo + 1;
+        for (cStep = 1; iHi < pft->cEntries && pft->pEntries[iHi].BeginAddress <= pRvas[i]; cStep <<= 1) {
+            iLo = iHi;
+            iHi += cStep;
+        }
+        if (iHi > pft->cEntries)
+            iHi = pft->cEntries;
+        j = PlUpperBoundFunction(pft->pEntries, iLo, iHi, pRvas[i]);
+        if (!j || pRvas[i] >= pft->pEntries[j - 1].EndAddress) {
+            lResult = LOGICAL_FALSE;
+            continue;
+        }
+        iLo = j - 1;
+        ppfe[i] = &pft->pEntries[iLo];
+    }
+    return lResult;
+}
@@ -34,12 +34,32 @@
 /// <returns>
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT error </returns>
 LOGICAL EXPORT LIBCALL PlAttachFile(IN const void* const pFileBase, OUT RAW_PE* rpe) {
+    return PlAttachFileEx(pFileBase, 0, rpe);
+}
+
+/// <summary>
+///	Fills VIRTUAL_PE with char* file's information, remembering the size of the buffer so
+/// that the overlay can be found </summary>
+///
+/// <param name="pModuleBase">
+/// Address of char* file target </param>
+/// <param name="cbFile">
+/// Size of buffer at pFileBase, 0 if unknown </param>
+/// <param name="vpe">
+/// Pointer to VIRTUAL_PE struct to recieve information about target </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT error </returns>
+LOGICAL EXPORT LIBCALL PlAttachFileEx(IN const void* const pFileBase, IN const size_t cbFile, OUT RAW_PE* rpe) {
 
     rpe->pDosHdr = (DOS_HEADER*)pFileBase;
+    rpe->cbBuffer = cbFile;
 #if ! ACCEPT_INVALID_SIGNATURES
     if (rpe->pDosHdr->e_magic != IMAGE_DOS_SIGNATURE)
         return LOGICAL_FALSE;
 #endif
+    if (cbFile && (cbFile < sizeof(DOS_HEADER) || (size_t)rpe->pDosHdr->e_lfanew + sizeof(NT_HEADERS) > cbFile))
+        return LOGICAL_FALSE;
     rpe->pDosStub = (DOS_STUB*)((PTR)rpe->pDosHdr + sizeof(DOS_HEADER));
     rpe->pNtHdr = (NT_HEADERS*)((PTR)rpe->pDosHdr + rpe->pDosHdr->e_lfanew);
 #if ACCEPT_INVALID_SIGNATURES
@@ -69,10 +89,71 @@ LOGICAL EXPORT LIBCALL PlAttachFile(IN const void* const pFileBase, OUT RAW_PE*
     }
     memset(&rpe->LoadStatus, 0, sizeof(rpe->LoadStatus));
     rpe->LoadStatus.Attached = TRUE;
+    rpe->hFile = NULL;
+    rpe->hMapping = NULL;
+    rpe->pDirty = NULL;
+    rpe->pContext = NULL;
     dmsg(TEXT("\nAttached to PE file at 0x%p"), rpe->pDosHdr);
     return LOGICAL_TRUE;
 }
 
+/// <summary>
+///	Maps a file from disk copy-on-write and fills rpe, writes never reach the file unless they are
+/// flushed with PlFlushDirty (the file stays open for writing by others). Release with PlFreeFile or PlReleaseFile </summary>
+///
+/// <param name="szFileName">
+/// Path of file to open </param>
+/// <param name="rpe">
+/// Pointer to RAW_PE struct to recieve information about target </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory/file error </returns>
+LOGICAL EXPORT LIBCALL PlOpenFile(IN LPCTSTR szFileName, OUT RAW_PE* rpe) {
+    HANDLE        hFile = INVALID_HANDLE_VALUE,
+                  hMapping = NULL;
+    void         *pView = NULL;
+    LARGE_INTEGER liSize;
+    LOGICAL       lResult = LOGICAL_MAYBE;
+
+    memset(rpe, 0, sizeof(*rpe));
+    // the handle lives as long as rpe, PlFlushDirty needs a writable one next to it
+    hFile = CreateFile(szFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return LOGICAL_MAYBE;
+    if (!GetFileSizeEx(hFile, &liSize) || !liSize.QuadPart || (uint64_t)liSize.QuadPart > (size_t)-1)
+        goto fail;
+    hMapping = CreateFileMapping(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (hMapping == NULL)
+        goto fail;
+    pView = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+    if (pView == NULL)
+        goto fail;
+    lResult = PlAttachFileEx(pView, (size_t)liSize.QuadPart, rpe);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        if (rpe->ppSecHdr != NULL)
+            free(rpe->ppSecHdr);
+        if (rpe->ppSectionData != NULL)
+            free(rpe->ppSectionData);
+        goto fail;
+    }
+    // we own the view now
+    rpe->LoadStatus.Attached = FALSE;
+    rpe->LoadStatus.Mapped = TRUE;
+    rpe->hFile = hFile;
+    rpe->hMapping = hMapping;
+    dmsg(TEXT("\nMapped PE file %s at 0x%p"), szFileName, pView);
+    return LOGICAL_TRUE;
+
+fail:
+    if (pView != NULL)
+        UnmapViewOfFile(pView);
+    if (hMapping != NULL)
+        CloseHandle(hMapping);
+    CloseHandle(hFile);
+    memset(rpe, 0, sizeof(*rpe));
+    return lResult;
+}
+
 /// <summary>
 ///	Zeros and deallocates memory from an attached RAW_PE. Only call if rpe::LoadStatus::Attached == TRUE </summary>
 ///
@@ -88,6 +169,8 @@ LOGICAL EXPORT LIBCALL PlDetachFile(INOUT RAW_PE* rpe) {
         free(rpe->ppSecHdr);
     if (rpe->ppSectionData != NULL)
         free(rpe->ppSectionData);
+    if (rpe->pDirty != NULL)
+        PlTrackDirty(rpe, FALSE);
     dmsg(TEXT("\nDetached from PE file at 0x%p"), rpe->pDosHdr);
     memset(rpe, 0, sizeof(*rpe));
 
@@ -95,46 +178,27 @@ LOGICAL EXPORT LIBCALL PlDetachFile(INOUT RAW_PE* rpe) {
 }
 
 /// <summary>
-///	Converts file to image alignment </summary>
-///
-/// <param name="rpe">
-/// Pointer to RAW_PE containing file </param>
-/// <param name="vm">
-/// Pointer to VIRTUAL_MODULE struct to recieve </param>
-///
-/// <returns>
-/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
-LOGICAL EXPORT LIBCALL PlFileToImage(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm) {
-    PTR MaxRva = 0;
-    void* pImage = NULL;
-    
-    if (!LOGICAL_SUCCESS(PlMaxRva(rpe, &MaxRva)))
-        return LOGICAL_FALSE;
-    pImage = VirtualAlloc(NULL, MaxRva, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    if (pImage == NULL)
-        return LOGICAL_MAYBE;
-    return PlFileToImageEx(rpe, pImage, vm);
-}
-
-/// <summary>
-///	Converts file to image alignment into provided buffer </summary>
+///	Converts file to image alignment, only copying raw data </summary>
 ///
 /// <param name="rpe">
 /// Pointer to RAW_PE containing file </param>
 /// <param name="pBuffer">
 /// Pointer to a buffer of at least PlMaxRva(rpe,) bytes with at least PAGE_READWRITE access
+/// <param name="bZeroed">
+/// TRUE if pBuffer is known to be zero filled (fresh VirtualAlloc), skips clearing it </param>
 /// <param name="vm">
 /// Pointer to VIRTUAL_MODULE struct to recieve </param>
 ///
 /// <returns>
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
-LOGICAL EXPORT LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuffer, OUT VIRTUAL_MODULE* vm) {
-    PTR MaxRva = 0;
+static LOGICAL PlFileToImageInternal(IN const RAW_PE* rpe, IN const void* pBuffer, IN const BOOL bZeroed, OUT VIRTUAL_MODULE* vm) {
+    PTR MaxRva = 0,
+        cbCopy = 0;
+    COPY_RANGE crWritten[MAX_SECTIONS + 2];     // headers, section table, sections
+    size_t     cWritten = 0;
 
-    // unnecessary per standard, but let's play nice with gaps
     if (!LOGICAL_SUCCESS(PlMaxRva(rpe, &MaxRva)))
         return LOGICAL_FALSE;
-    memset((void*)pBuffer, 0, MaxRva);
 
     vm->pBaseAddr = (void*)pBuffer;
     vm->PE.pDosHdr = (DOS_HEADER*)vm->pBaseAddr;
@@ -143,6 +207,8 @@ LOGICAL EXPORT LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuf
     memmove(vm->PE.pDosStub, rpe->pDosStub, rpe->pDosHdr->e_lfanew - sizeof(DOS_HEADER));
     vm->PE.pNtHdr = (NT_HEADERS*)((PTR)vm->pBaseAddr + vm->PE.pDosHdr->e_lfanew);
     memmove(vm->PE.pNtHdr, rpe->pNtHdr, sizeof(NT_HEADERS));
+    crWritten[cWritten].Offset = 0;
+    crWritten[cWritten++].cbSize = vm->PE.pDosHdr->e_lfanew + sizeof(NT_HEADERS);
     if (vm->PE.pNtHdr->FileHeader.NumberOfSections) {
         WORD wNumSections = vm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : vm->PE.pNtHdr->FileHeader.NumberOfSections;
         if (vm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS) 
@@ -154,19 +220,300 @@ LOGICAL EXPORT LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuf
         vm->PE.ppSectionData = malloc(wNumSections * sizeof(*vm->PE.ppSectionData));
         if (vm->PE.ppSectionData == NULL)
             return LOGICAL_MAYBE;
+        crWritten[cWritten].Offset = (PTR)&vm->PE.pNtHdr->OptionalHeader + vm->PE.pNtHdr->FileHeader.SizeOfOptionalHeader - (PTR)pBuffer;
+        crWritten[cWritten++].cbSize = wNumSections * sizeof(SECTION_HEADER);
         for (register size_t i = 0; i < wNumSections; ++i) {
             vm->PE.ppSecHdr[i] = (SECTION_HEADER*)((PTR)&vm->PE.pNtHdr->OptionalHeader + vm->PE.pNtHdr->FileHeader.SizeOfOptionalHeader + sizeof(SECTION_HEADER) * i);
             memmove(vm->PE.ppSecHdr[i], rpe->ppSecHdr[i], sizeof(SECTION_HEADER));
             vm->PE.ppSectionData[i] = (void*)((PTR)vm->pBaseAddr + vm->PE.ppSecHdr[i]->VirtualAddress);
-            memmove(vm->PE.ppSectionData[i], rpe->ppSectionData[i], vm->PE.ppSecHdr[i]->Misc.VirtualSize);  // virtualsize isn't aligned (may break codecaves)
+            // past raw data is uninitialized (already zero), virtualsize isn't aligned (may break codecaves)
+            cbCopy = vm->PE.ppSecHdr[i]->SizeOfRawData;
+            if (vm->PE.ppSecHdr[i]->Misc.VirtualSize && vm->PE.ppSecHdr[i]->Misc.VirtualSize < cbCopy)
+                cbCopy = vm->PE.ppSecHdr[i]->Misc.VirtualSize;
+            // never past the buffer, whatever the headers claim
+            if (vm->PE.ppSecHdr[i]->VirtualAddress >= MaxRva)
+                cbCopy = 0;
+            else if (cbCopy > MaxRva - vm->PE.ppSecHdr[i]->VirtualAddress)
+                cbCopy = MaxRva - vm->PE.ppSecHdr[i]->VirtualAddress;
+            PlCopyMemory(vm->PE.ppSectionData[i], rpe->ppSectionData[i], cbCopy);
+            crWritten[cWritten].Offset = (PTR)vm->PE.ppSectionData[i] - (PTR)pBuffer;
+            crWritten[cWritten++].cbSize = cbCopy;
         }
     } else {
         vm->PE.ppSecHdr = NULL;
         vm->PE.ppSectionData = NULL;
     }
+    // unnecessary per standard, but let's play nice with gaps (only the gaps, the rest was just written)
+    if (!bZeroed)
+        PlZeroGaps((void*)pBuffer, MaxRva, crWritten, cWritten);
     memset(&vm->PE.LoadStatus, 0, sizeof(vm->PE.LoadStatus));
     vm->PE.LoadStatus = rpe->LoadStatus;
     vm->PE.LoadStatus.Attached = FALSE;
+    vm->PE.LoadStatus.Mapped = FALSE;
+    vm->PE.LoadStatus.Tracked = FALSE;
+    vm->PE.pDirty = NULL;
+    vm->PE.LoadStatus.Pooled = FALSE;
+    vm->PE.LoadStatus.Image = TRUE;
+    vm->PE.pContext = rpe->pContext;
+    vm->PE.hFile = NULL;
+    vm->PE.hMapping = NULL;
+    vm->PE.cbBuffer = MaxRva;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Converts file to image alignment </summary>
+///
+/// <param name="rpe">
+/// Pointer to RAW_PE containing file </param>
+/// <param name="vm">
+/// Pointer to VIRTUAL_MODULE struct to recieve </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlFileToImage(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm) {
+    PTR MaxRva = 0;
+    void* pImage = NULL;
+    LOGICAL lResult = LOGICAL_FALSE;
+    
+    if (!LOGICAL_SUCCESS(PlMaxRva(rpe, &MaxRva)))
+        return LOGICAL_FALSE;
+    // fresh pages are demand-zero, only the ones we copy into get touched (pooled ones are cleared)
+    if (!LOGICAL_SUCCESS(PlPoolAlloc(rpe->pContext, MaxRva, &pImage)))
+        return LOGICAL_MAYBE;
+    lResult = PlFileToImageInternal(rpe, pImage, TRUE, vm);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        PlPoolFree(rpe->pContext, pImage, MaxRva);
+        return lResult;
+    }
+    vm->PE.LoadStatus.Pooled = rpe->pContext != NULL;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Converts file to image alignment into provided buffer </summary>
+///
+/// <param name="rpe">
+/// Pointer to RAW_PE containing file </param>
+/// <param name="pBuffer">
+/// Pointer to a buffer of at least PlMaxRva(rpe,) bytes with at least PAGE_READWRITE access
+/// <param name="vm">
+/// Pointer to VIRTUAL_MODULE struct to recieve </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuffer, OUT VIRTUAL_MODULE* vm) {
+    return PlFileToImageInternal(rpe, pBuffer, FALSE, vm);
+}
+
+/// <summary>
+///	Gets the iAttempt'th base to try when placing an image near Preferred, alternating above and below it </summary>
+///
+/// <returns>
+/// Base, 0 if it would fall outside of the address space </returns>
+static PTR PlPlacementCandidate(IN const SYSTEM_INFO* si, IN const PTR Preferred, IN const PTR cbImage, IN const size_t iAttempt) {
+    PTR MinAddress = (PTR)si->dwAllocationGranularity,
+        MaxAddress = (PTR64)si->lpMaximumApplicationAddress > (PTR)-1 ? (PTR)-1 : (PTR)si->lpMaximumApplicationAddress,
+        cbStep = cbImage * ((iAttempt + 1) / 2),
+        Base = 0;
+
+    if (iAttempt && cbStep / cbImage != (iAttempt + 1) / 2)
+        return 0;
+    if (iAttempt % 2) {
+        if (Preferred > MaxAddress - cbStep)
+            return 0;
+        Base = Preferred + cbStep;
+    } else {
+        if (Preferred < MinAddress + cbStep)
+            return 0;
+        Base = Preferred - cbStep;
+    }
+    if (Base > MaxAddress - cbImage + 1)
+        return 0;
+    return Base;
+}
+
+/// <summary>
+///	Checks whether an image can be relocated, files without a .reloc have to load at ImageBase </summary>
+static BOOL PlIsRelocatable(IN const RAW_PE* rpe) {
+    return !(rpe->pNtHdr->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED)
+        && rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress
+        && rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size;
+}
+
+/// <summary>
+///	Converts file to image alignment at a chosen base (ImageBase by default) so relocating can be skipped.
+/// If the base is taken, bases next to it are tried and then any address, and the image is relocated
+/// (ImageBase is updated, like the system loader does) </summary>
+///
+/// <param name="rpe">
+/// Pointer to RAW_PE containing file </param>
+/// <param name="PreferredBase">
+/// Base to load at, 0 for OptionalHeader.ImageBase (PlPlanImageBases gives bases for several modules) </param>
+/// <param name="vm">
+/// Pointer to VIRTUAL_MODULE struct to recieve </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error or if the image can't be relocated and 
+/// ImageBase is taken, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlFileToImageAt(IN const RAW_PE* rpe, IN const PTR PreferredBase, OUT VIRTUAL_MODULE* vm) {
+    SYSTEM_INFO si;
+    PTR         MaxRva = 0,
+                cbImage = 0,
+                Preferred = PreferredBase ? PreferredBase : rpe->pNtHdr->OptionalHeader.ImageBase,
+                Base = 0;
+    void       *pImage = NULL;
+    BOOL        bRelocatable = PlIsRelocatable(rpe);
+    LOGICAL     lResult = LOGICAL_FALSE;
+
+    if (!LOGICAL_SUCCESS(PlMaxRva(rpe, &MaxRva)))
+        return LOGICAL_FALSE;
+    GetSystemInfo(&si);
+    cbImage = PlAlignUp(MaxRva, si.dwAllocationGranularity);
+    if (!bRelocatable)
+        Preferred = rpe->pNtHdr->OptionalHeader.ImageBase;
+    for (register size_t i = 0; pImage == NULL && i <= (bRelocatable ? 2 * PLACEMENT_ATTEMPTS : 0); ++i) {
+        Base = PlPlacementCandidate(&si, Preferred, cbImage, i);
+        // fails if anything is reserved in the way
+        if (Base)
+            pImage = VirtualAlloc((void*)Base, MaxRva, IMAGE_ALLOC_TYPE, PAGE_READWRITE);
+    }
+    if (pImage == NULL && bRelocatable)
+        pImage = VirtualAlloc(NULL, MaxRva, IMAGE_ALLOC_TYPE, PAGE_READWRITE);
+    if (pImage == NULL) {
+        dmsg(TEXT("\nCould not place PE file at 0x%p (or anywhere it could be relocated to)"), rpe->pDosHdr);
+        return bRelocatable ? LOGICAL_MAYBE : LOGICAL_FALSE;
+    }
+    lResult = PlFileToImageInternal(rpe, pImage, TRUE, vm);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        VirtualFree(pImage, 0, MEM_RELEASE);
+        return lResult;
+    }
+    if ((PTR)pImage != vm->PE.pNtHdr->OptionalHeader.ImageBase) {
+        lResult = PlRelocate(&vm->PE, vm->PE.pNtHdr->OptionalHeader.ImageBase, (PTR)pImage);
+        if (!LOGICAL_SUCCESS(lResult)) {
+            PlFreeImage(vm);
+            return lResult;
+        }
+        vm->PE.pNtHdr->OptionalHeader.ImageBase = (PTR)pImage;
+        dmsg(TEXT("\nPE file at 0x%p placed at 0x%p instead of 0x%p"), rpe->pDosHdr, pImage, (void*)Preferred);
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Picks a base for each of a set of files that will be loaded together, so no two overlap and none
+/// lands on memory that is already in use. Modules keep their ImageBase when possible, the ones that
+/// can't be relocated are placed first so the rest move around them </summary>
+///
+/// <param name="prpe">
+/// Array of RAW_PE containing files </param>
+/// <param name="cModules">
+/// Number of files in prpe </param>
+/// <param name="pBases">
+/// Array of cModules PTRs that will recieve bases to pass to PlFileToImageAt, 0 if none was found </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error </returns>
+LOGICAL EXPORT LIBCALL PlPlanImageBases(IN const RAW_PE* prpe, IN const size_t cModules, OUT PTR* pBases) {
+    MEMORY_BASIC_INFORMATION mbi;
+    SYSTEM_INFO si;
+    PTR         MaxRva = 0,
+                cbImage = 0,
+                cbOther = 0,
+                Base = 0;
+    BOOL        bRelocatable = FALSE,
+                bFree = FALSE;
+
+    GetSystemInfo(&si);
+    memset(pBases, 0, cModules * sizeof(*pBases));
+    // pass 0 places fixed modules, pass 1 relocatable ones
+    for (register size_t iPass = 0; iPass < 2; ++iPass) {
+        for (register size_t i = 0; i < cModules; ++i) {
+            bRelocatable = PlIsRelocatable(&prpe[i]);
+            if (bRelocatable != (iPass == 1))
+                continue;
+            if (!LOGICAL_SUCCESS(PlMaxRva(&prpe[i], &MaxRva)))
+                return LOGICAL_FALSE;
+            cbImage = PlAlignUp(MaxRva, si.dwAllocationGranularity);
+            if (!bRelocatable) {
+                pBases[i] = prpe[i].pNtHdr->OptionalHeader.ImageBase;
+                continue;
+            }
+            for (register size_t k = 0; !pBases[i] && k <= 2 * PLACEMENT_ATTEMPTS; ++k) {
+                Base = PlPlacementCandidate(&si, prpe[i].pNtHdr->OptionalHeader.ImageBase, cbImage, k);
+                if (!Base)
+                    continue;
+                // free regions are coalesced, so one query covers the whole range if it's free
+                bFree = VirtualQuery((void*)Base, &mbi, sizeof(mbi)) == sizeof(mbi)
+                     && mbi.State == MEM_FREE
+                     && (PTR)mbi.BaseAddress + mbi.RegionSize - Base >= cbImage;
+                for (register size_t j = 0; bFree && j < cModules; ++j) {
+                    if (j == i || !pBases[j] || !LOGICAL_SUCCESS(PlMaxRva(&prpe[j], &cbOther)))
+                        continue;
+                    cbOther = PlAlignUp(cbOther, si.dwAllocationGranularity);
+                    if (Base < pBases[j] + cbOther && pBases[j] < Base + cbImage)
+                        bFree = FALSE;
+                }
+                if (bFree)
+                    pBases[i] = Base;
+            }
+            if (pBases[i] && pBases[i] != prpe[i].pNtHdr->OptionalHeader.ImageBase)
+                dmsg(TEXT("\nPlanned PE file at 0x%p for 0x%p instead of 0x%p"), prpe[i].pDosHdr, (void*)pBases[i], (void*)prpe[i].pNtHdr->OptionalHeader.ImageBase);
+        }
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Converts file to image alignment by letting the system map the file as an image (copy-on-write),
+/// so section data is paged in from the file instead of copied. Only used for files opened with
+/// PlOpenFile whose FileAlignment and SectionAlignment are multiples of the page size, anything
+/// else (or a file the system refuses to map) falls back to PlFileToImage </summary>
+///
+/// <param name="rpe">
+/// Pointer to RAW_PE containing file </param>
+/// <param name="vm">
+/// Pointer to VIRTUAL_MODULE struct to recieve </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlFileToImageMapped(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm) {
+    SYSTEM_INFO si;
+    HANDLE      hMapping = NULL;
+    void       *pView = NULL;
+
+    if (rpe->hFile == NULL)
+        return PlFileToImage(rpe, vm);
+    GetSystemInfo(&si);
+    if (!rpe->pNtHdr->OptionalHeader.FileAlignment || rpe->pNtHdr->OptionalHeader.FileAlignment % si.dwPageSize
+     || !rpe->pNtHdr->OptionalHeader.SectionAlignment || rpe->pNtHdr->OptionalHeader.SectionAlignment % si.dwPageSize)
+        return PlFileToImage(rpe, vm);
+    hMapping = CreateFileMapping(rpe->hFile, NULL, PAGE_READONLY | SEC_IMAGE, 0, 0, NULL);
+    if (hMapping == NULL) {
+        dmsg(TEXT("\nCould not map PE file at 0x%p as image, copying instead"), rpe->pDosHdr);
+        return PlFileToImage(rpe, vm);
+    }
+    pView = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+    if (pView == NULL) {
+        CloseHandle(hMapping);
+        return PlFileToImage(rpe, vm);
+    }
+    if (!LOGICAL_SUCCESS(PlAttachImage(pView, vm))) {
+        if (vm->PE.ppSecHdr != NULL)
+            free(vm->PE.ppSecHdr);
+        if (vm->PE.ppSectionData != NULL)
+            free(vm->PE.ppSectionData);
+        UnmapViewOfFile(pView);
+        CloseHandle(hMapping);
+        return PlFileToImage(rpe, vm);
+    }
+    // system applied section protection already
+    vm->PE.LoadStatus.Attached = FALSE;
+    vm->PE.LoadStatus.Mapped = TRUE;
+    vm->PE.LoadStatus.Protected = TRUE;
+    vm->PE.pContext = rpe->pContext;
+    vm->PE.hMapping = hMapping;
     return LOGICAL_TRUE;
 }
 
@@ -183,13 +530,19 @@ LOGICAL EXPORT LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuf
 LOGICAL EXPORT LIBCALL PlCopyFile(IN const RAW_PE* rpe, OUT RAW_PE* crpe) {
     PTR MaxPa = 0;
     void* pCopy = NULL;
+    LOGICAL lResult = LOGICAL_FALSE;
 
-    if (!LOGICAL_SUCCESS(PlMaxRva(rpe, &MaxPa)))
+    if (!LOGICAL_SUCCESS(PlMaxPa(rpe, &MaxPa)))
         return LOGICAL_FALSE;
-    pCopy = VirtualAlloc(NULL, MaxPa, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    if (pCopy == NULL)
+    if (!LOGICAL_SUCCESS(PlPoolAlloc(rpe->pContext, MaxPa, &pCopy)))
         return LOGICAL_MAYBE;
-    return PlCopyFileEx(rpe, pCopy, crpe);
+    lResult = PlCopyFileEx(rpe, pCopy, crpe);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        PlPoolFree(rpe->pContext, pCopy, MaxPa);
+        return lResult;
+    }
+    crpe->LoadStatus.Pooled = rpe->pContext != NULL;
+    return LOGICAL_TRUE;
 }
 
 /// <summary>
@@ -206,11 +559,11 @@ LOGICAL EXPORT LIBCALL PlCopyFile(IN const RAW_PE* rpe, OUT RAW_PE* crpe) {
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
 LOGICAL EXPORT LIBCALL PlCopyFileEx(IN const RAW_PE* rpe, IN void* pBuffer, OUT RAW_PE* crpe) {
     PTR MaxPa = 0;
+    COPY_RANGE crWritten[MAX_SECTIONS + 2];     // headers, section table, sections
+    size_t     cWritten = 0;
 
-    // unnecessary per standard, but let's play nice with gaps
     if (!LOGICAL_SUCCESS(PlMaxPa(rpe, &MaxPa)))
         return LOGICAL_FALSE;
-    memset(pBuffer, 0, MaxPa);
 
     crpe->pDosHdr = (DOS_HEADER*)pBuffer;
     memmove(crpe->pDosHdr, rpe->pDosHdr, sizeof(DOS_HEADER));
@@ -218,6 +571,8 @@ LOGICAL EXPORT LIBCALL PlCopyFileEx(IN const RAW_PE* rpe, IN void* pBuffer, OUT
     memmove(crpe->pDosStub, rpe->pDosStub, (PTR)crpe->pDosHdr->e_lfanew - sizeof(DOS_HEADER));
     crpe->pNtHdr = (NT_HEADERS*)((PTR)crpe->pDosHdr + crpe->pDosHdr->e_lfanew);
     memmove(crpe->pNtHdr, rpe->pNtHdr, sizeof(NT_HEADERS));
+    crWritten[cWritten].Offset = 0;
+    crWritten[cWritten++].cbSize = crpe->pDosHdr->e_lfanew + sizeof(NT_HEADERS);
     if (crpe->pNtHdr->FileHeader.NumberOfSections) {
         WORD wNumSections = crpe->pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : crpe->pNtHdr->FileHeader.NumberOfSections;
         if (crpe->pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS) 
@@ -229,19 +584,33 @@ LOGICAL EXPORT LIBCALL PlCopyFileEx(IN const RAW_PE* rpe, IN void* pBuffer, OUT
         crpe->ppSectionData = malloc(wNumSections * sizeof(*crpe->ppSectionData));
         if (crpe->ppSectionData == NULL)
             return LOGICAL_MAYBE;
+        crWritten[cWritten].Offset = (PTR)&crpe->pNtHdr->OptionalHeader + crpe->pNtHdr->FileHeader.SizeOfOptionalHeader - (PTR)pBuffer;
+        crWritten[cWritten++].cbSize = wNumSections * sizeof(SECTION_HEADER);
         for (register size_t i = 0; i < wNumSections; ++i) {
             crpe->ppSecHdr[i] = (SECTION_HEADER*)((PTR)&crpe->pNtHdr->OptionalHeader + crpe->pNtHdr->FileHeader.SizeOfOptionalHeader + sizeof(SECTION_HEADER) * i);
             memmove(crpe->ppSecHdr[i], rpe->ppSecHdr[i], sizeof(SECTION_HEADER));
             crpe->ppSectionData[i] = (void*)((PTR)crpe->pDosHdr + crpe->ppSecHdr[i]->PointerToRawData);
-            memmove(crpe->ppSectionData[i], rpe->ppSectionData[i], crpe->ppSecHdr[i]->SizeOfRawData);
+            PlCopyMemory(crpe->ppSectionData[i], rpe->ppSectionData[i], crpe->ppSecHdr[i]->SizeOfRawData);
+            crWritten[cWritten].Offset = (PTR)crpe->ppSectionData[i] - (PTR)pBuffer;
+            crWritten[cWritten++].cbSize = crpe->ppSecHdr[i]->SizeOfRawData;
         }
     } else {
         crpe->ppSecHdr = NULL;
         crpe->ppSectionData = NULL;
     }
+    // unnecessary per standard, but let's play nice with gaps (only the gaps, the rest was just written)
+    PlZeroGaps((void*)pBuffer, MaxPa, crWritten, cWritten);
     memset(&crpe->LoadStatus, 0, sizeof(crpe->LoadStatus));
     crpe->LoadStatus = rpe->LoadStatus;
     crpe->LoadStatus.Attached = FALSE;
+    crpe->LoadStatus.Mapped = FALSE;
+    crpe->LoadStatus.Tracked = FALSE;
+    crpe->pDirty = NULL;
+    crpe->LoadStatus.Pooled = FALSE;
+    crpe->pContext = rpe->pContext;
+    crpe->hFile = NULL;
+    crpe->hMapping = NULL;
+    crpe->cbBuffer = MaxPa;     // overlay isn't copied
     return LOGICAL_TRUE;
 }
 
@@ -261,7 +630,24 @@ LOGICAL EXPORT LIBCALL PlFreeFile(INOUT RAW_PE* rpe) {
         free(rpe->ppSecHdr);
     if (rpe->ppSectionData != NULL)
         free(rpe->ppSectionData);
-    VirtualFree(rpe->pDosHdr, 0, MEM_RELEASE);
+    if (rpe->pDirty != NULL)
+        PlTrackDirty(rpe, FALSE);
+    if (rpe->LoadStatus.Mapped) {
+        UnmapViewOfFile(rpe->pDosHdr);
+        if (rpe->hMapping != NULL)
+            CloseHandle(rpe->hMapping);
+        if (rpe->hFile != NULL)
+            CloseHandle(rpe->hFile);
+    } else {
+        // the pool hands buffers out read/write, one PlProtectImage left otherwise is released instead
+        if (rpe->LoadStatus.Pooled && rpe->LoadStatus.Protected) {
+            DWORD dwProtect = 0;
+
+            if (!VirtualProtect(rpe->pDosHdr, rpe->cbBuffer, PAGE_READWRITE, &dwProtect))
+                rpe->LoadStatus.Pooled = FALSE;
+        }
+        PlPoolFree(rpe->LoadStatus.Pooled ? rpe->pContext : NULL, rpe->pDosHdr, rpe->cbBuffer);
+    }
     memset(rpe, 0, sizeof(*rpe));
     return LOGICAL_TRUE;
 }
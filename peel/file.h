@@ -26,10 +26,16 @@
 
 #pragma region File functions
     LOGICAL EXPORT LIBCALL PlAttachFile(IN const void* const pFileBase, OUT RAW_PE* rpe);
+    LOGICAL EXPORT LIBCALL PlAttachFileEx(IN const void* const pFileBase, IN const size_t cbFile, OUT RAW_PE* rpe);
     LOGICAL EXPORT LIBCALL PlDetachFile(INOUT RAW_PE* rpe);
 
+    LOGICAL EXPORT LIBCALL PlOpenFile(IN LPCTSTR szFileName, OUT RAW_PE* rpe);
+
     LOGICAL EXPORT LIBCALL PlFileToImage(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm);
     LOGICAL EXPORT LIBCALL PlFileToImageEx(IN const RAW_PE* rpe, IN const void* pBuffer, OUT VIRTUAL_MODULE* vm);
+    LOGICAL EXPORT LIBCALL PlFileToImageMapped(IN const RAW_PE* rpe, OUT VIRTUAL_MODULE* vm);
+    LOGICAL EXPORT LIBCALL PlFileToImageAt(IN const RAW_PE* rpe, IN const PTR PreferredBase, OUT VIRTUAL_MODULE* vm);
+    LOGICAL EXPORT LIBCALL PlPlanImageBases(IN const RAW_PE* prpe, IN const size_t cModules, OUT PTR* pBases);
     
     LOGICAL EXPORT LIBCALL PlCopyFile(IN const RAW_PE* rpe, OUT RAW_PE* crpe);
     LOGICAL EXPORT LIBCALL PlCopyFileEx(IN const RAW_PE* rpe, IN void* pBuffer, OUT RAW_PE* crpe);
@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "graph.h"
+
+typedef struct _SCC_STATE {
+    DEPENDENCY_GRAPH *pdg;
+    DWORD            *pIndex,       // visit order + 1, 0 if not visited yet
+                     *pLow,
+                     *pStack,
+                     *pEmitted;     // nodes in the order their components completed
+    BOOL             *pbOnStack;
+    DWORD             iNext,
+                      cStack,
+                      cEmitted,
+                      cComponents;
+} SCC_STATE;
+
+typedef struct _LOAD_BATCH {
+    PEEL_CONTEXT     *ctx;
+    DEPENDENCY_GRAPH *pdg;
+    LPCTSTR           szSearchPath;
+    const DWORD      *pNodes;       // one level of pOrder
+    LONG              cNodes;
+    LONG volatile     iNext;        // next pNodes entry to be taken
+    BOOL              bBind;        // FALSE maps, TRUE binds
+} LOAD_BATCH;
+
+/// <summary>
+///	Finds or appends the node of a bind module </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlAddNode(INOUT DEPENDENCY_GRAPH* pdg, IN BIND_MODULE* pbm, OUT DWORD* piNode) {
+    DEPENDENCY_NODE *pNodes = NULL;
+    size_t           cMaxNodes = 0;
+
+    for (register size_t i = 0; i < pdg->cNodes; ++i) {
+        if (pdg->pNodes[i].pbm == pbm) {
+            *piNode = (DWORD)i;
+            return LOGICAL_TRUE;
+        }
+    }
+    if (pdg->cNodes == pdg->cMaxNodes) {
+        cMaxNodes = pdg->cMaxNodes ? pdg->cMaxNodes * 2 : 0x20;
+        pNodes = calloc(cMaxNodes, sizeof(*pNodes));
+        if (pNodes == NULL)
+            return LOGICAL_MAYBE;
+        if (pdg->pNodes != NULL) {
+            memcpy(pNodes, pdg->pNodes, pdg->cNodes * sizeof(*pNodes));
+            free(pdg->pNodes);
+        }
+        pdg->pNodes = pNodes;
+        pdg->cMaxNodes = cMaxNodes;
+    }
+    pdg->pNodes[pdg->cNodes].pbm = pbm;
+    pdg->pNodes[pdg->cNodes].dwComponent = (DWORD)-1;
+    *piNode = (DWORD)pdg->cNodes++;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Adds a node's imported libraries to the graph as edges, libraries that can't be found are counted and skipped </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlAddEdges(INOUT PEEL_CONTEXT* ctx, INOUT DEPENDENCY_GRAPH* pdg, IN const DWORD iNode, IN LPCTSTR szSearchPath) {
+    RAW_PE         *rpe = &pdg->pNodes[iNode].pbm->PE;
+    IMPORT_LIBRARY *pIL = NULL;
+    BIND_MODULE    *pbm = NULL;
+    DWORD           cLibraries = 0,
+                    iEdge = 0;
+    LOGICAL         lResult = LOGICAL_FALSE;
+
+    // the bind module's file is shared, its imports are only enumerated once
+    if (rpe->pImport == NULL) {
+        lResult = PlEnumerateImports(rpe);
+        if (!LOGICAL_SUCCESS(lResult))
+            return lResult;
+    }
+    for (pIL = rpe->pImport; pIL != NULL; pIL = (IMPORT_LIBRARY*)pIL->Flink)
+        ++cLibraries;
+    if (!cLibraries)
+        return LOGICAL_TRUE;
+    pdg->pNodes[iNode].pEdges = malloc(cLibraries * sizeof(*pdg->pNodes[iNode].pEdges));
+    if (pdg->pNodes[iNode].pEdges == NULL)
+        return LOGICAL_MAYBE;
+    for (pIL = rpe->pImport; pIL != NULL; pIL = (IMPORT_LIBRARY*)pIL->Flink) {
+        // delay loaded libraries aren't needed to load the module
+        if (pIL->Library == NULL || pIL->pDelayDesc != NULL)
+            continue;
+        lResult = PlGetBindModule(ctx, pIL->Library, szSearchPath, &pbm);
+        if (!LOGICAL_SUCCESS(lResult)) {
+            if (lResult == LOGICAL_MAYBE)
+                return LOGICAL_MAYBE;
+            ++pdg->cMissing;
+            continue;
+        }
+        // pNodes can move here
+        lResult = PlAddNode(pdg, pbm, &iEdge);
+        if (!LOGICAL_SUCCESS(lResult))
+            return lResult;
+        for (register DWORD i = 0; i <= pdg->pNodes[iNode].cEdges; ++i) {
+            if (i == pdg->pNodes[iNode].cEdges) {
+                pdg->pNodes[iNode].pEdges[pdg->pNodes[iNode].cEdges++] = iEdge;
+                break;
+            }
+            if (pdg->pNodes[iNode].pEdges[i] == iEdge)
+                break;
+        }
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Tarjan's strongly connected components. Edges point at dependencies, so a component completes
+/// after everything it imports and its level can be set right away </summary>
+static void PlStrongConnect(INOUT SCC_STATE* scc, IN const DWORD v) {
+    DEPENDENCY_NODE *pNodes = scc->pdg->pNodes;
+    DWORD            w = 0,
+                     iFirst = 0,
+                     dwLevel = 0;
+    BOOL             bCycle = FALSE;
+
+    scc->pIndex[v] = scc->pLow[v] = ++scc->iNext;
+    scc->pStack[scc->cStack++] = v;
+    scc->pbOnStack[v] = TRUE;
+    for (register DWORD i = 0; i < pNodes[v].cEdges; ++i) {
+        w = pNodes[v].pEdges[i];
+        if (!scc->pIndex[w]) {
+            PlStrongConnect(scc, w);
+            if (scc->pLow[w] < scc->pLow[v])
+                scc->pLow[v] = scc->pLow[w];
+        } else if (scc->pbOnStack[w] && scc->pIndex[w] < scc->pLow[v])
+            scc->pLow[v] = scc->pIndex[w];
+    }
+    if (scc->pLow[v] != scc->pIndex[v])
+        return;
+    // v roots a component, its members are the stack down to v
+    iFirst = scc->cStack;
+    do {
+        w = scc->pStack[--iFirst];
+        scc->pbOnStack[w] = FALSE;
+        pNodes[w].dwComponent = scc->cComponents;
+    } while (w != v);
+    bCycle = scc->cStack - iFirst > 1;
+    for (register DWORD i = iFirst; i < scc->cStack; ++i) {
+        w = scc->pStack[i];
+        for (register DWORD j = 0; j < pNodes[w].cEdges; ++j) {
+            if (pNodes[pNodes[w].pEdges[j]].dwComponent != scc->cComponents) {
+                if (pNodes[pNodes[w].pEdges[j]].dwLevel + 1 > dwLevel)
+                    dwLevel = pNodes[pNodes[w].pEdges[j]].dwLevel + 1;
+            } else if (pNodes[w].pEdges[j] == w)
+                bCycle = TRUE;
+        }
+    }
+    for (register DWORD i = iFirst; i < scc->cStack; ++i) {
+        w = scc->pStack[i];
+        pNodes[w].dwLevel = dwLevel;
+        pNodes[w].bCycle = bCycle;
+        scc->pEmitted[scc->cEmitted++] = w;
+    }
+    scc->pdg->bCycles |= bCycle;
+    scc->cStack = iFirst;
+    ++scc->cComponents;
+}
+
+/// <summary>
+///	Finds cycles and levels, then sorts nodes into pOrder by level </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlOrderGraph(INOUT DEPENDENCY_GRAPH* pdg) {
+    SCC_STATE scc;
+    DWORD    *pBuffer = NULL;
+
+    if (!pdg->cNodes)
+        return LOGICAL_TRUE;
+    memset(&scc, 0, sizeof(scc));
+    scc.pdg = pdg;
+    pBuffer = calloc(4 * pdg->cNodes, sizeof(*pBuffer));
+    scc.pbOnStack = calloc(pdg->cNodes, sizeof(*scc.pbOnStack));
+    pdg->pOrder = malloc(pdg->cNodes * sizeof(*pdg->pOrder));
+    if (pBuffer == NULL || scc.pbOnStack == NULL || pdg->pOrder == NULL) {
+        if (pBuffer != NULL)
+            free(pBuffer);
+        if (scc.pbOnStack != NULL)
+            free(scc.pbOnStack);
+        return LOGICAL_MAYBE;
+    }
+    scc.pIndex = pBuffer;
+    scc.pLow = pBuffer + pdg->cNodes;
+    scc.pStack = pBuffer + 2 * pdg->cNodes;
+    scc.pEmitted = pBuffer + 3 * pdg->cNodes;
+    for (register DWORD i = 0; i < pdg->cNodes; ++i) {
+        if (!scc.pIndex[i])
+            PlStrongConnect(&scc, i);
+        if (pdg->pNodes[i].dwLevel + 1 > pdg->cLevels)
+            pdg->cLevels = pdg->pNodes[i].dwLevel + 1;
+    }
+    free(scc.pbOnStack);
+    pdg->pLevelStart = calloc((pdg->cLevels + 1), sizeof(*pdg->pLevelStart));
+    if (pdg->pLevelStart == NULL) {
+        free(pBuffer);
+        return LOGICAL_MAYBE;
+    }
+    // counting sort, stable so every level keeps completion order
+    for (register DWORD i = 0; i < pdg->cNodes; ++i)
+        ++pdg->pLevelStart[pdg->pNodes[i].dwLevel + 1];
+    for (register size_t i = 1; i <= pdg->cLevels; ++i)
+        pdg->pLevelStart[i] += pdg->pLevelStart[i - 1];
+    // pLow is free again, use it as the fill cursor of each level
+    memcpy(scc.pLow, pdg->pLevelStart, pdg->cLevels * sizeof(*scc.pLow));
+    for (register DWORD i = 0; i < scc.cEmitted; ++i)
+        pdg->pOrder[scc.pLow[pdg->pNodes[scc.pEmitted[i]].dwLevel]++] = scc.pEmitted[i];
+    free(pBuffer);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Builds the transitive import graph of a set of modules, finds cycles and sorts it into
+/// levels that only import from lower levels </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT, files are opened through its bind cache </param>
+/// <param name="pszModules">
+/// Array of module file names to start from </param>
+/// <param name="cModules">
+/// Number of names in pszModules </param>
+/// <param name="szSearchPath">
+/// ';' separated directories modules are looked for in </param>
+/// <param name="pdg">
+/// Receives the graph, free with PlFreeDependencyGraph </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success (check cMissing), LOGICAL_FALSE if a module in pszModules can't be found or on PE error,
+/// LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlBuildDependencyGraph(INOUT PEEL_CONTEXT* ctx, IN const char* const* pszModules, IN const size_t cModules, IN LPCTSTR szSearchPath, OUT DEPENDENCY_GRAPH* pdg) {
+    BIND_MODULE *pbm = NULL;
+    DWORD        iNode = 0;
+    LOGICAL      lResult = LOGICAL_FALSE;
+
+    memset(pdg, 0, sizeof(*pdg));
+    for (register size_t i = 0; i < cModules; ++i) {
+        lResult = PlGetBindModule(ctx, pszModules[i], szSearchPath, &pbm);
+        if (LOGICAL_SUCCESS(lResult))
+            lResult = PlAddNode(pdg, pbm, &iNode);
+        if (!LOGICAL_SUCCESS(lResult)) {
+            PlFreeDependencyGraph(pdg);
+            return lResult;
+        }
+    }
+    // nodes are appended as they're discovered, so this walks the graph breadth first
+    for (register DWORD i = 0; i < pdg->cNodes; ++i) {
+        lResult = PlAddEdges(ctx, pdg, i, szSearchPath);
+        if (!LOGICAL_SUCCESS(lResult)) {
+            PlFreeDependencyGraph(pdg);
+            return lResult;
+        }
+    }
+    lResult = PlOrderGraph(pdg);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        PlFreeDependencyGraph(pdg);
+        return lResult;
+    }
+    dmsg(TEXT("\nDependency graph of %u modules in %u levels, %u libraries missing%s"), (unsigned int)pdg->cNodes,
+         (unsigned int)pdg->cLevels, (unsigned int)pdg->cMissing, pdg->bCycles ? TEXT(", has cycles") : TEXT(""));
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Maps or binds one node </summary>
+static void PlLoadNode(INOUT LOAD_BATCH* pBatch, IN const DWORD iNode) {
+    DEPENDENCY_NODE *pNode = &pBatch->pdg->pNodes[iNode];
+
+    if (!pBatch->bBind) {
+        pNode->lLoaded = PlFileToImageAt(&pNode->pbm->PE, 0, &pNode->vm);
+        if (!LOGICAL_SUCCESS(pNode->lLoaded))
+            memset(&pNode->vm, 0, sizeof(pNode->vm));
+    } else if (LOGICAL_SUCCESS(pNode->lLoaded))
+        pNode->lLoaded = PlBindImports(pBatch->ctx, &pNode->vm.PE, pBatch->szSearchPath);
+}
+
+static DWORD WINAPI PlLoadThread(LPVOID lpBatch) {
+    LOAD_BATCH *pBatch = (LOAD_BATCH*)lpBatch;
+    LONG        iNext = 0;
+
+    while ((iNext = InterlockedIncrement(&pBatch->iNext) - 1) < pBatch->cNodes)
+        PlLoadNode(pBatch, pBatch->pNodes[iNext]);
+    return 0;
+}
+
+/// <summary>
+///	Runs a batch on up to LOAD_THREADS threads, the calling thread being one of them </summary>
+static void PlRunBatch(INOUT LOAD_BATCH* pBatch) {
+    HANDLE hThreads[LOAD_THREADS - 1];
+    size_t cThreads = 0;
+
+    pBatch->iNext = 0;
+    while (cThreads < LOAD_THREADS - 1 && cThreads + 1 < (size_t)pBatch->cNodes) {
+        hThreads[cThreads] = CreateThread(NULL, 0, PlLoadThread, pBatch, 0, NULL);
+        if (hThreads[cThreads] == NULL)
+            break;
+        ++cThreads;
+    }
+    PlLoadThread(pBatch);
+    if (cThreads) {
+        WaitForMultipleObjects((DWORD)cThreads, hThreads, TRUE, INFINITE);
+        for (register size_t i = 0; i < cThreads; ++i)
+            CloseHandle(hThreads[i]);
+    }
+}
+
+/// <summary>
+///	Maps and binds every module of a graph a level at a time, modules of one level are loaded concurrently.
+/// Modules are bound against where their dependencies were actually placed and are registered under their names </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT the graph was built with </param>
+/// <param name="pdg">
+/// Graph from PlBuildDependencyGraph, each node's lLoaded receives its result </param>
+/// <param name="szSearchPath">
+/// ';' separated directories forwarded modules are looked for in </param>
+///
+/// <returns>
+/// LOGICAL_TRUE if every module loaded, LOGICAL_FALSE if any failed, LOGICAL_MAYBE if any failed on crt/memory error </returns>
+LOGICAL EXPORT LIBCALL PlLoadDependencyGraph(INOUT PEEL_CONTEXT* ctx, INOUT DEPENDENCY_GRAPH* pdg, IN LPCTSTR szSearchPath) {
+    LOAD_BATCH       lbLevel;
+    DEPENDENCY_NODE *pNode = NULL;
+    MODULE_ENTRY    *pme = NULL;
+    LOGICAL          lResult = LOGICAL_TRUE;
+
+    memset(&lbLevel, 0, sizeof(lbLevel));
+    lbLevel.ctx = ctx;
+    lbLevel.pdg = pdg;
+    lbLevel.szSearchPath = szSearchPath;
+    for (register size_t i = 0; i < pdg->cLevels; ++i) {
+        lbLevel.pNodes = &pdg->pOrder[pdg->pLevelStart[i]];
+        lbLevel.cNodes = (LONG)(pdg->pLevelStart[i + 1] - pdg->pLevelStart[i]);
+        lbLevel.bBind = FALSE;
+        PlRunBatch(&lbLevel);
+        // modules on a cycle bind against each other, so every base has to be known before any binding starts
+        for (register LONG j = 0; j < lbLevel.cNodes; ++j) {
+            pNode = &pdg->pNodes[lbLevel.pNodes[j]];
+            if (!LOGICAL_SUCCESS(pNode->lLoaded))
+                continue;
+            pNode->pbm->Base = (PTR)pNode->vm.pBaseAddr;
+            if (LOGICAL_SUCCESS(PlRegisterModule(ctx, pNode->pbm->Library, &pNode->vm, &pme)) && pme->vm != &pNode->vm)
+                PlReleaseModule(ctx, pme, NULL);
+        }
+        lbLevel.bBind = TRUE;
+        PlRunBatch(&lbLevel);
+    }
+    for (register size_t i = 0; i < pdg->cNodes; ++i) {
+        if (pdg->pNodes[i].lLoaded == LOGICAL_MAYBE)
+            lResult = LOGICAL_MAYBE;
+        else if (!LOGICAL_SUCCESS(pdg->pNodes[i].lLoaded) && lResult != LOGICAL_MAYBE)
+            lResult = LOGICAL_FALSE;
+    }
+    return lResult;
+}
+
+/// <summary>
+///	Frees a graph and every image PlLoadDependencyGraph loaded for it </summary>
+///
+/// <param name="pdg">
+/// Graph from PlBuildDependencyGraph </param>
+///
+/// <returns>
+/// LOGICAL_TRUE, *pdg is zeroed </returns>
+LOGICAL EXPORT LIBCALL PlFreeDependencyGraph(INOUT DEPENDENCY_GRAPH* pdg) {
+    for (register size_t i = 0; i < pdg->cNodes; ++i) {
+        if (pdg->pNodes[i].vm.pBaseAddr != NULL) {
+            if (pdg->pNodes[i].vm.PE.pImport != NULL)
+                PlFreeEnumeratedImports(&pdg->pNodes[i].vm.PE);
+            PlFreeImage(&pdg->pNodes[i].vm);
+            // later binds go against the file's own base again
+            pdg->pNodes[i].pbm->Base = pdg->pNodes[i].pbm->PE.pNtHdr->OptionalHeader.ImageBase;
+        }
+        if (pdg->pNodes[i].pEdges != NULL)
+            free(pdg->pNodes[i].pEdges);
+    }
+    if (pdg->pNodes != NULL)
+        free(pdg->pNodes);
+    if (pdg->pOrder != NULL)
+        free(pdg->pOrder);
+    if (pdg->pLevelStart != NULL)
+        free(pdg->pLevelStart);
+    memset(pdg, 0, sizeof(*pdg));
+    return LOGICAL_TRUE;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "peel.h"
+
+#pragma region Graph functions
+    // szSearchPath is a ';' separated list of directories, like PlBindImports
+    LOGICAL EXPORT LIBCALL PlBuildDependencyGraph(INOUT PEEL_CONTEXT* ctx, IN const char* const* pszModules, IN const size_t cModules, IN LPCTSTR szSearchPath, OUT DEPENDENCY_GRAPH* pdg);
+    LOGICAL EXPORT LIBCALL PlLoadDependencyGraph(INOUT PEEL_CONTEXT* ctx, INOUT DEPENDENCY_GRAPH* pdg, IN LPCTSTR szSearchPath);
+    LOGICAL EXPORT LIBCALL PlFreeDependencyGraph(INOUT DEPENDENCY_GRAPH* pdg);
+#pragma endregion
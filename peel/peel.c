@@ -83,31 +83,6 @@ PTR32 EXPORT LIBCALL PlAlignDown(IN const PTR offset, IN const PTR alignment) {
 ///
 /// <returns>
 /// Page protection for use with VirtualProtect </returns>
-DWORD EXPORT LIBCALL PlSectionToPageProtection(IN const DWORD dwCharacteristics) {
-    
-    //if (dwProtect & IMAGE_SCN_CNT_CODE)
-    //    dwProtect |= IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_EXECUTE;
-    //if (dwProtect & IMAGE_SCN_CNT_INITIALIZED_DATA
-    // || dwProtect & IMAGE_SCN_CNT_UNINITIALIZED_DATA)
-    // dwProtect |= IMAGE_SCN_MEM_READ;
-    // 1st bit is mem_shared, ignore it, #idgaf about r0
-
-    DWORD dwProtect = (dwCharacteristics >> (3 * CHAR_BIT + 5)) & 007;
-    if (dwProtect & 0x1)    // execute
-        dwProtect <<= 4;    // execute is in second nibble for some reason
-
-    if (dwProtect & 0xe0)   // all except execute
-        dwProtect &= ~0x10; // clear execute nibble (implicit)
-
-    if (!dwProtect)         // no protection bits set
-        dwProtect = PAGE_NOACCESS;
-
-    if (dwCharacteristics & IMAGE_SCN_MEM_NOT_CACHED)
-        dwProtect |= PAGE_NOCACHE;
-
-    return dwProtect;
-}
-
 DWORD EXPORT LIBCALL PlSectionToPageProtection(IN const DWORD dwCharacteristics) {
     DWORD dwProtect = dwCharacteristics;
     
@@ -129,6 +104,7 @@ DWORD EXPORT LIBCALL PlSectionToPageProtection(IN const DWORD dwCharacteristics)
         case 5: // execute write (?)
         case 7: // all access
             dwProtect = PAGE_EXECUTE_READWRITE;
+            break;
         default:
             dwProtect = PAGE_NOACCESS;
             break;
@@ -169,3 +145,29 @@ DWORD EXPORT LIBCALL PlPageToSectionProtection(IN const DWORD dwProtection) {
         dwChar |= IMAGE_SCN_CNT_INITIALIZED_DATA;
     return dwChar;
 }
+
+/// <summary>
+///	Hashes a buffer in place, 8 bytes at a time (FNV-1a constants with an extra fold) </summary>
+///
+/// <param name="pData">
+/// Buffer to hash </param>
+/// <param name="cbData">
+/// Size of buffer </param>
+///
+/// <returns>
+/// 64 bit hash, not suitable for crypto </returns>
+PTR64 EXPORT LIBCALL PlHashData(IN const void* pData, IN const size_t cbData) {
+    const uint8_t *pCurr = (const uint8_t*)pData;
+    PTR64          qwHash = 0xcbf29ce484222325ULL,
+                   qwBlock = 0;
+    size_t         cbLeft = cbData;
+
+    for (; cbLeft >= sizeof(qwBlock); cbLeft -= sizeof(qwBlock), pCurr += sizeof(qwBlock)) {
+        memcpy(&qwBlock, pCurr, sizeof(qwBlock));   // unaligned safe, compiles to a single load
+        qwHash = (qwHash ^ qwBlock) * 0x100000001b3ULL;
+        qwHash ^= qwHash >> 32;                     // fold high bits back down so they matter
+    }
+    for (; cbLeft; --cbLeft)
+        qwHash = (qwHash ^ *pCurr++) * 0x100000001b3ULL;
+    return qwHash ^ cbData;
+}
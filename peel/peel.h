@@ -46,9 +46,9 @@ X = done
     [*] x64 support ( lol )
     [X]	Loading a PE file
     [X] Imports/Exports ( simply needs to be integrated into new RAW_PE format... todo )
-    [ ] Resources ( 0xffffffffffffffffUL)
+    [X] Resources ( walked in place, see resource.c )
     [X] Relocations ( simply needs to be integrated into new RAW_PE format... todo )
-    [ ] TLS ( lack of documentation requires RE )
+    [X] TLS ( directory, callbacks and per-thread blocks, see tls.c )
     [X] Add logging for debugging... ( why wasn't this done before? bp are annoying ) [ 8/2/13 ]
 
     What we don't care about:
@@ -83,7 +83,11 @@ Additional notes:
             PTR     Relocated : 1,  // relocations are resolved
                     Imported  : 1,  // imports are resolved
                     Protected : 1,  // image has proper protection
-                    Attached  : 1;  // points to an externally allocated image
+                    Attached  : 1,  // points to an externally allocated image
+                    Mapped    : 1,  // backed by a view of hMapping, released with UnmapViewOfFile
+                    Tracked   : 1,  // PlWriteRva/PlWritePa record file ranges in pDirty
+                    Pooled    : 1,  // buffer came from pContext's pool, goes back there when freed
+                    Image     : 1;  // image aligned, sections sit at their rvas and cbBuffer is MaxRva
         } PE_FLAGS;
 
         typedef struct _CODECAVE_LINKED_LIST32 {
@@ -100,12 +104,28 @@ Additional notes:
             char  *Name,          // ptr to function name (NULL if by ordinal)
                   *Ordinal;       // ptr to DWORD ordinal number (NULL if by name)
             PTR32 *dwItemPtr;     // ptr to IAT entry
+            WORD   Hint;          // likely index into exporter's AddressOfNames (0 if by ordinal)
             void  *Flink;
         } IMPORT_ITEM;       // forward linked list of imports
 
+        typedef struct _DELAY_IMPORT_DESCRIPTOR {
+            DWORD   Attributes,             // DELAY_ATTRIBUTE_RVA if the fields below are rvas, vas otherwise
+                    DllNameRva,
+                    ModuleHandleRva,
+                    ImportAddressTableRva,
+                    ImportNameTableRva,
+                    BoundImportAddressTableRva,
+                    UnloadInformationTableRva,
+                    TimeDateStamp;
+        } DELAY_IMPORT_DESCRIPTOR;    // IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT entry, sdks before win8 don't have it
+
         typedef struct _IMPORT_LIBRARY_FLIST {
             char          *Library; // ptr to char* that hold library name
             IMPORT_ITEM   *iiImportList;
+            THUNK_DATA    *ptdNames,    // ILT (OriginalFirstThunk), FirstThunk if the linker left it out
+                          *ptdIat;      // IAT (FirstThunk), holds addresses once bound or loaded
+            DWORD          BoundTimeDateStamp;      // TimeDateStamp of library the IAT was bound against (0 if not bound)
+            DELAY_IMPORT_DESCRIPTOR *pDelayDesc;    // descriptor if delay loaded (NULL otherwise)
             void          *Flink;
         } IMPORT_LIBRARY;
 
@@ -117,14 +137,71 @@ Additional notes:
         } EXPORT_LIST;
 
         typedef struct _RESOURCE_ITEM_FLIST {
-            PTR    dwType;
-            char  *Name;
-            PTR    wId; // only use lower WORD
-            size_t cbSize;
-            void  *pData,
-                  *Flink;
+            PTR                  dwType;    // type id (0 if named)
+            RESOURCE_DIR_STRING *TypeName;  // ptr to counted unicode type name (NULL if by id)
+            RESOURCE_DIR_STRING *Name;      // ptr to counted unicode name (NULL if by id)
+            PTR                  wId;       // only use lower WORD
+            PTR                  wLang;     // only use lower WORD
+            DWORD                dwCodePage;
+            size_t               cbSize;
+            void                *pData,     // ptr into image, not a copy
+                                *Flink;
         } RESOURCE_LIST;
+
+        typedef struct _DIRTY_RANGE_FLIST {
+            PTR     Offset,     // file offset
+                    cbSize;
+            void   *Flink;
+        } DIRTY_RANGE;      // sorted, ranges never overlap or touch
+
+        typedef struct _COPY_RANGE {
+            PTR     Offset;     // offset into destination buffer
+            size_t  cbSize;
+        } COPY_RANGE;       // part of a buffer a conversion wrote to
+
+        typedef struct _OVERLAY_VIEW {
+            PTR     Offset;     // file offset of overlay (PlMaxPa)
+            size_t  cbSize;     // cb of overlay (can be 0)
+            void   *pData;      // ptr into backing buffer, not a copy (NULL if cbSize is 0)
+            PTR64   qwHash;     // PlHashData of overlay
+        } OVERLAY_VIEW;     // data appended after the last section
         
+        typedef struct _POOL_BUFFER_FLIST {
+            void   *pBuffer;    // reserves its whole size class
+            size_t  cbCommitted;// committed from pBuffer on, the rest is only reserved
+            void   *Flink;
+        } POOL_BUFFER;
+
+        typedef struct _MODULE_ENTRY_FLIST {
+            char       *Name;           // lowercase module name (owned)
+            PTR64       qwNameHash;
+            struct _VIRTUAL_PE_MODULE32 *vm;
+            PTR         Base;           // vm->pBaseAddr
+            size_t      cbImage;        // SizeOfImage
+            DWORD       cRefs;
+            void       *NameFlink,      // next entry in same name bucket
+                       *BaseFlink;      // next entry in same base bucket
+        } MODULE_ENTRY;
+
+        typedef struct _MODULE_REGISTRY {
+            MODULE_ENTRY  *pByName[REGISTRY_BUCKETS],   // buckets hashed on lowercase name
+                          *pByBase[REGISTRY_BUCKETS];   // buckets hashed on base (allocation granularity)
+            MODULE_ENTRY **ppRanges;        // sorted by Base, image ranges never overlap
+            size_t         cModules,
+                           cMaxModules;     // capacity of ppRanges
+        } MODULE_REGISTRY; // loaded modules by name, base and address
+
+        typedef struct _PEEL_CONTEXT {
+            CRITICAL_SECTION csLock;
+            POOL_BUFFER     *pPool[POOL_CLASSES];   // free buffers, class n holds POOL_MIN_CLASS << n bytes
+            size_t           cbPooled,              // cb of buffers sitting in pPool
+                             cbPoolMax,             // pool releases buffers beyond this
+                             cbLargePage;           // large page size once PlEnableLargePages succeeds, 0 otherwise
+            struct _IMAGE_TEMPLATE_FLIST *pTemplates;   // forward-linked list of templates (PlGetTemplate)
+            struct _BIND_MODULE_FLIST    *pBindCache;   // forward-linked list of dependencies (PlBindImports)
+            MODULE_REGISTRY  Registry;              // modules registered with PlRegisterModule
+        } PEEL_CONTEXT;    // state shared by everything loaded through it
+
         typedef struct _RAW_PE {
             DOS_HEADER		  *pDosHdr;
             DOS_STUB 		  *pDosStub;
@@ -136,12 +213,17 @@ Additional notes:
             SECTION_HEADER   **ppSecHdr;		    // array pointing to section headers
             void		     **ppSectionData;       // array pointing to section data
             PE_FLAGS		   LoadStatus;
+            size_t             cbBuffer;            // cb of backing buffer (0 if unknown)
+            HANDLE             hFile,               // file opened by PlOpenFile (NULL otherwise)
+                               hMapping;            // section backing pDosHdr if LoadStatus.Mapped
 // essentials (pointers only)
 // the following allocate memory and, however are only used when their respective functions are called
             CODECAVE_LIST     *pCaveData;	    // forward-linked list containing codecaves
             IMPORT_LIBRARY    *pImport;              // forward-linked list of imports
             EXPORT_LIST       *pExport;              // forward-linked list of exports
             RESOURCE_LIST     *pResource;              // forward-linked list of resources
+            DIRTY_RANGE       *pDirty;                 // forward-linked list of written file ranges (PlTrackDirty)
+            PEEL_CONTEXT      *pContext;               // optional, set after attaching, copied by conversions
         } RAW_PE;	// wraps PE file
 
 
@@ -157,6 +239,223 @@ Additional notes:
            uint16_t Offset	: 12,
                     Type	: 4;
         } RELOC_ITEM;
+
+        typedef struct _RESOURCE_ITERATOR {
+            const RAW_PE             *rpe;
+            RESOURCE_DIRECTORY       *prdRoot;      // start of resource directory
+            PTR                       cbRoot;       // cb of resource directory
+            RESOURCE_DIRECTORY_ENTRY *prdeLevel[3]; // next entry at type, name and language level
+            DWORD                     dwLeft[3];    // entries left at each level (named + id can exceed a WORD)
+            int                       iDepth;       // current level (-1 when done)
+        } RESOURCE_ITERATOR;   // walks resource tree in place, no allocation
+
+        typedef struct _VERSION_INFO {
+            VS_FIXEDFILEINFO *pFixedInfo;       // NULL if missing or signature is wrong
+            WORD              wLang,            // translation of string table below
+                              wCodePage;
+            const WCHAR      *CompanyName,      // ptrs into image, NULL if missing
+                             *FileDescription,
+                             *FileVersion,
+                             *InternalName,
+                             *LegalCopyright,
+                             *OriginalFilename,
+                             *ProductName,
+                             *ProductVersion;
+            const void       *pStringTable;     // first StringTable block, for PlQueryVersionString
+            size_t            cbStringTable;
+        } VERSION_INFO;    // VS_VERSIONINFO parsed in place
+
+        typedef struct _IMAGE_SNAPSHOT {
+            VIRTUAL_MODULE   *vm;
+            void             *pBaseline;        // copy of image when snapshot was taken
+            size_t            cbImage;
+            PE_FLAGS          LoadStatus;       // flags when snapshot was taken
+            BOOL              bWriteWatch;      // image tracks its own writes (MEM_WRITE_WATCH)
+            void            **ppDirty;          // GetWriteWatch output, one entry per page
+            size_t            cPages,
+                              cRestored;        // pages copied back by last PlRestoreImage
+        } IMAGE_SNAPSHOT;  // baseline of an image to reset it to
+
+        typedef struct _PROTECT_RUN {
+            PTR     Rva,        // page aligned
+                    cbSize;     // page aligned
+            DWORD   dwProtect;
+        } PROTECT_RUN;
+
+        typedef struct _PROTECT_PLAN {
+            PROTECT_RUN *pRuns;     // sorted, adjacent runs never share protection
+            size_t       cRuns,     // VirtualProtect calls needed
+                         cSaved;    // calls saved over one per header/section
+        } PROTECT_PLAN;    // page protection of an image in as few calls as possible
+
+        typedef struct _IMAGE_TEMPLATE_FLIST {
+            PTR64           qwKey;          // PlGetFileIdentity of file
+            DWORD           TimeDateStamp,  // of file, to match without waiting for vm
+                            SizeOfImage;
+            HANDLE          hBuilt;         // manual-reset event, set once building is done
+            volatile BOOL   bBuilding;      // vm is still being built, wait on hBuilt
+            LOGICAL         lBuild;         // result of building
+            size_t          cWaiters;       // threads waiting on hBuilt, the last one frees a failed template
+            VIRTUAL_MODULE  vm;             // shared (PlShareImage) image, never relocated
+            PTR             Base;           // base vm's contents are correct for (ImageBase)
+            DWORD          *pFixups32,      // rvas of HIGHLOW relocations
+                           *pFixups64;      // rvas of DIR64 relocations
+            size_t          cFixups32,
+                            cFixups64;
+            void           *Flink;
+        } IMAGE_TEMPLATE;  // prepared image instances are stamped out of
+
+        typedef struct _EXPORT_NAME {
+            const char *Name;
+            WORD        wIndex;         // index into AddressOfFunctions
+        } EXPORT_NAME;
+
+        typedef struct _BIND_MODULE_FLIST {
+            char        *Library;       // lowercase file name (owned)
+            RAW_PE       PE;            // dependency opened with PlOpenFile
+            PTR          Base;          // base imports are bound against (ImageBase)
+            DWORD       *pFunctions;    // AddressOfFunctions
+            DWORD        cFunctions,
+                         OrdinalBase,
+                         ExportRva,     // rvas inside the export directory are forwarders
+                         cbExport,
+                         cNames;
+            EXPORT_NAME *pNames,        // sorted by name (owned)
+                        *pNamesByHint;  // AddressOfNames order, same as pNames if that was already sorted
+            void        *Flink;
+        } BIND_MODULE;     // dependency indexed for PlBindImports
+
+        typedef struct _DEPENDENCY_NODE {
+            BIND_MODULE    *pbm;            // file on disk, from the bind cache
+            VIRTUAL_MODULE  vm;             // image once PlLoadDependencyGraph mapped it
+            DWORD          *pEdges;         // nodes this one imports from (owned)
+            DWORD           cEdges,
+                            dwLevel,        // loads after every lower level, 0 imports nothing in the graph
+                            dwComponent;    // strongly connected component, modules on one cycle share it
+            BOOL            bCycle;         // imports itself through other modules
+            LOGICAL         lLoaded;        // result of mapping and binding it
+        } DEPENDENCY_NODE;
+
+        typedef struct _DEPENDENCY_GRAPH {
+            DEPENDENCY_NODE *pNodes;        // roots first (owned)
+            DWORD           *pOrder,        // node indices, dependencies before dependents (owned)
+                            *pLevelStart;   // pOrder index each level starts at, cLevels + 1 entries (owned)
+            size_t           cNodes,
+                             cMaxNodes,     // capacity of pNodes
+                             cLevels,
+                             cMissing;      // imported libraries that couldn't be found
+            BOOL             bCycles;
+        } DEPENDENCY_GRAPH; // transitive imports of a set of modules
+
+        typedef struct _TLS_INFO {
+            TLS_DIRECTORY  *ptdDir;         // ptr into image
+            void           *pTemplate;      // StartAddressOfRawData, ptr into image
+            size_t          cbTemplate;     // EndAddressOfRawData - StartAddressOfRawData
+            DWORD           cbZeroFill,     // SizeOfZeroFill, zeroed after the template
+                            dwAlignment;    // alignment of a block (IMAGE_SCN_ALIGN_XXX in Characteristics, 0x10 at least)
+            DWORD          *pdwIndex;       // AddressOfIndex, ptr into image (NULL if there is none)
+            PTR            *pCallbacks;     // AddressOfCallBacks, ptr into image, VAs ending with 0 (NULL if there are none)
+            size_t          cCallbacks;
+        } TLS_INFO;        // TLS directory resolved to pointers
+
+        typedef struct _TLS_POOL {
+            CRITICAL_SECTION csLock;
+            TLS_INFO        Info;           // parsed once by PlGetTlsInfo
+            size_t          cbBlock;        // template + zero fill, aligned to Info.dwAlignment
+            void           *pSlabs,         // forward-linked list of slabs blocks are carved from
+                           *pFree;          // forward-linked list of freed blocks (link is the first PTR of a block)
+            BYTE           *pCarve;         // next uncarved block of newest slab
+            size_t          cCarve;         // blocks left in newest slab
+        } TLS_POOL;        // per-thread TLS blocks of one image
+
+        typedef struct _FUNCTION_ENTRY {
+            DWORD           BeginAddress,   // rva of first byte
+                            EndAddress,     // rva past last byte
+                            UnwindData;     // rva of UNWIND_INFO
+        } FUNCTION_ENTRY;  // x64 RUNTIME_FUNCTION, exception directory (.pdata) entry
+
+        typedef struct _FUNCTION_TABLE {
+            const FUNCTION_ENTRY *pEntries; // sorted by BeginAddress, ptr into image or pOwned
+            FUNCTION_ENTRY *pOwned;         // sorted copy, only if the image's table wasn't (owned)
+            size_t          cEntries;
+        } FUNCTION_TABLE;  // validated exception directory
+
+        typedef struct _LOAD_CONFIG_DIRECTORY32 {
+            DWORD   Size,                   // cb of the fields the linker knew about, the rest reads as 0
+                    TimeDateStamp;
+            WORD    MajorVersion,
+                    MinorVersion;
+            DWORD   GlobalFlagsClear,
+                    GlobalFlagsSet,
+                    CriticalSectionDefaultTimeout,
+                    DeCommitFreeBlockThreshold,
+                    DeCommitTotalFreeThreshold,
+                    LockPrefixTable,
+                    MaximumAllocationSize,
+                    VirtualMemoryThreshold,
+                    ProcessHeapFlags,
+                    ProcessAffinityMask;
+            WORD    CSDVersion,
+                    DependentLoadFlags;
+            DWORD   EditList,
+                    SecurityCookie,
+                    SEHandlerTable,
+                    SEHandlerCount,
+                    GuardCFCheckFunctionPointer,
+                    GuardCFDispatchFunctionPointer,
+                    GuardCFFunctionTable,   // va of rva + (GuardFlags & GUARD_CF_STRIDE_MASK) >> GUARD_CF_STRIDE_SHIFT bytes entries
+                    GuardCFFunctionCount,
+                    GuardFlags;
+        } LOAD_CONFIG_DIRECTORY32;    // IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG, sdks before win8.1 don't have the guard fields
+
+        typedef struct _LOAD_CONFIG_DIRECTORY64 {
+            DWORD   Size,
+                    TimeDateStamp;
+            WORD    MajorVersion,
+                    MinorVersion;
+            DWORD   GlobalFlagsClear,
+                    GlobalFlagsSet,
+                    CriticalSectionDefaultTimeout;
+            PTR64   DeCommitFreeBlockThreshold,
+                    DeCommitTotalFreeThreshold,
+                    LockPrefixTable,
+                    MaximumAllocationSize,
+                    VirtualMemoryThreshold,
+                    ProcessAffinityMask;
+            DWORD   ProcessHeapFlags;
+            WORD    CSDVersion,
+                    DependentLoadFlags;
+            PTR64   EditList,
+                    SecurityCookie,
+                    SEHandlerTable,
+                    SEHandlerCount,
+                    GuardCFCheckFunctionPointer,
+                    GuardCFDispatchFunctionPointer,
+                    GuardCFFunctionTable,
+                    GuardCFFunctionCount;
+            DWORD   GuardFlags;
+        } LOAD_CONFIG_DIRECTORY64;
+
+#if SUPPORT_PE32PLUS
+        typedef LOAD_CONFIG_DIRECTORY64 LOAD_CONFIG_DIRECTORY;
+#else
+        typedef LOAD_CONFIG_DIRECTORY32 LOAD_CONFIG_DIRECTORY;
+#endif
+
+        typedef struct _GUARD_CF_BITMAP {
+            BYTE           *pBits;          // 2 bits per 16 bytes of image, valid at the start of the slot | valid anywhere in it (owned)
+            DWORD           cbImage;        // SizeOfImage the bitmap covers
+            size_t          cTargets;       // GuardCFFunctionTable entries set in pBits
+        } GUARD_CF_BITMAP; // control flow guard call targets
+
+        typedef struct _CODEVIEW_INFO {
+            DEBUG_DIRECTORY *pddEntry;      // CodeView entry of the debug directory, ptr into PE
+            DWORD            dwSignature;   // CODEVIEW_SIGNATURE_RSDS or CODEVIEW_SIGNATURE_NB10
+            GUID             Guid;          // RSDS only
+            DWORD            dwTimeStamp,   // NB10 only, stands in for the guid
+                             dwAge;         // bumped by every incremental link
+            const char      *szPdbPath;     // ptr into PE, as the linker wrote it
+        } CODEVIEW_INFO;   // identity of the pdb matching an image (symbol server key)
 #	pragma pack(pop)
 #pragma endregion
 
@@ -178,8 +477,21 @@ Additional notes:
     // conversions
     DWORD EXPORT LIBCALL PlSectionToPageProtection(IN const DWORD dwCharacteristics);
     DWORD EXPORT LIBCALL PlPageToSectionProtection(IN const DWORD dwProtection);
+    // hashing
+    PTR64 EXPORT LIBCALL PlHashData(IN const void* pData, IN const size_t cbData);
 #pragma endregion
 
 #include "raw.h"
 #include "file.h"
 #include "virtual.h"
+#include "resource.h"
+#include "cave.h"
+#include "context.h"
+#include "copy.h"
+#include "template.h"
+#include "bind.h"
+#include "registry.h"
+#include "graph.h"
+#include "tls.h"
+#include "except.h"
+#include "config.h"
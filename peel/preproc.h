@@ -42,6 +42,22 @@
 #	define USE_NATIVE_FUNCTIONS				TRUE	// will attempt to use native functions (only windoze)
 #	define NO_CRT							FALSE	// plz use
 #	define ACCEPT_INVALID_SIGNATURES		TRUE	// ignore magic and checksums
+#	define USE_SIMD							TRUE	// use SSE2/AVX2 kernels when the cpu has them (gcc only)
+#	define MIN_CODECAVE_SIZE				0x10	// default minimum cb for a run to count as a codecave
+#	define WRITE_WATCH_IMAGES				TRUE	// allocate images with MEM_WRITE_WATCH so restoring snapshots only visits written pages
+#	define POOL_CLASSES						0x10	// buffer pool size classes, POOL_MIN_CLASS << 0x0f is the biggest pooled buffer
+#	define POOL_MIN_CLASS					0x10000	// smallest pooled buffer (allocation granularity)
+#	define POOL_DEFAULT_MAX					0x10000000	// cb a context keeps pooled if not told otherwise
+#	define LARGE_PAGE_IMAGES				TRUE	// PlEnableLargePages can back big image buffers with large pages
+#	define LARGE_PAGE_THRESHOLD				0x800000	// smallest buffer that gets large pages
+#	define STREAM_COPY_THRESHOLD			0x100000	// copies this big bypass the cache (non-temporal stores)
+#	define PARALLEL_COPY_THRESHOLD			0x4000000	// copies this big are split across threads
+#	define COPY_THREADS						4		// most threads a single copy is split across
+#	define PLACEMENT_ATTEMPTS				0x10	// bases tried on each side of the preferred one before loading anywhere
+#	define MAX_FORWARD_DEPTH				8		// forwarded exports followed before giving up (forwarder loops)
+#	define REGISTRY_BUCKETS					0x100	// hash buckets of a context's module registry (power of 2)
+#	define LOAD_THREADS						8		// most threads loading one level of a dependency graph
+#	define TLS_BLOCKS_PER_SLAB				0x40	// TLS blocks a pool allocates at once
 
 #	define MAX_DBG_STRING_LEN				0x100	// max strlen
 #	define LIBCALL							__stdcall // go ahead and use whatevs
@@ -148,6 +148,53 @@ LOGICAL EXPORT LIBCALL PlGetPaPtr(IN const RAW_PE* rpe, IN const PTR Pa, OUT PTR
     return PlGetRvaPtr(rpe, Rva, Ptr);
 }
 
+/// <summary>
+///	Adds a file range to rpe->pDirty, merging it with any range it overlaps or touches </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlMarkDirty(INOUT RAW_PE* rpe, IN const PTR Pa, IN const size_t cbData) {
+    DIRTY_RANGE *pPrev = NULL,
+                *pRange = rpe->pDirty,
+                *pNext = NULL;
+    PTR          End = Pa + cbData;
+
+    if (!cbData)
+        return LOGICAL_TRUE;
+    // edits mostly land after or on the last one, but the list stays short either way
+    while (pRange != NULL && pRange->Offset + pRange->cbSize < Pa) {
+        pPrev = pRange;
+        pRange = (DIRTY_RANGE*)pRange->Flink;
+    }
+    if (pRange == NULL || pRange->Offset > End) {
+        pNext = calloc(1, sizeof(DIRTY_RANGE));
+        if (pNext == NULL)
+            return LOGICAL_MAYBE;
+        pNext->Offset = Pa;
+        pNext->cbSize = cbData;
+        pNext->Flink = pRange;
+        if (pPrev == NULL)
+            rpe->pDirty = pNext;
+        else
+            pPrev->Flink = pNext;
+        return LOGICAL_TRUE;
+    }
+    // grow pRange, then swallow whatever it reaches now
+    if (Pa < pRange->Offset) {
+        pRange->cbSize += pRange->Offset - Pa;
+        pRange->Offset = Pa;
+    }
+    if (End > pRange->Offset + pRange->cbSize)
+        pRange->cbSize = End - pRange->Offset;
+    while ((pNext = (DIRTY_RANGE*)pRange->Flink) != NULL && pNext->Offset <= pRange->Offset + pRange->cbSize) {
+        if (pNext->Offset + pNext->cbSize > pRange->Offset + pRange->cbSize)
+            pRange->cbSize = pNext->Offset + pNext->cbSize - pRange->Offset;
+        pRange->Flink = pNext->Flink;
+        free(pNext);
+    }
+    return LOGICAL_TRUE;
+}
+
 /// <summary>
 ///	Writes buffer to specified RVA. Allows for overlapping segments </summary>
 ///
@@ -161,13 +208,17 @@ LOGICAL EXPORT LIBCALL PlGetPaPtr(IN const RAW_PE* rpe, IN const PTR Pa, OUT PTR
 /// Size of buffer </param>
 ///
 /// <returns>
-/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error </returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE if the write couldn't be tracked </returns>
 LOGICAL EXPORT LIBCALL PlWriteRva(INOUT RAW_PE* rpe, IN const PTR Rva, IN const void* pData, IN size_t cbData) {
-    PTR ptr = 0;
+    PTR ptr = 0,
+        Pa = 0;
 
     if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva, &ptr)))
         return LOGICAL_FALSE;
     memmove((void*)ptr, pData, cbData);
+    // anything without a file offset never reaches the file anyways
+    if (rpe->LoadStatus.Tracked && LOGICAL_SUCCESS(PlRvaToPa(rpe, Rva, &Pa)))
+        return PlMarkDirty(rpe, Pa, cbData);
     return LOGICAL_TRUE;
 }
 
@@ -207,7 +258,7 @@ LOGICAL EXPORT LIBCALL PlReadRva(IN const RAW_PE* rpe, IN const PTR Rva, IN void
 /// Size of data to copy </param>
 ///
 /// <returns>
-/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error </returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE if the write couldn't be tracked </returns>
 LOGICAL EXPORT LIBCALL PlWritePa(INOUT RAW_PE* rpe, IN const PTR Pa, IN const void* pData, IN size_t cbData) {
     PTR Rva = 0;
 
@@ -238,6 +289,86 @@ LOGICAL EXPORT LIBCALL PlReadPa(IN const RAW_PE* rpe, IN const PTR Pa, IN void*
     return PlReadRva(rpe, Rva, pBuffer, cbBufferMax); 
 }
 
+/// <summary>
+///	Starts or stops recording which file ranges PlWriteRva and PlWritePa change, stopping drops
+/// anything recorded. Ranges are file offsets, so tracking can't be enabled on an image aligned PE </summary>
+///
+/// <param name="rpe">
+/// Loaded file aligned RAW_PE struct </param>
+/// <param name="bEnable">
+/// TRUE to record writes in rpe->pDirty </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if rpe is image aligned (LoadStatus.Image) </returns>
+LOGICAL EXPORT LIBCALL PlTrackDirty(INOUT RAW_PE* rpe, IN const BOOL bEnable) {
+    DIRTY_RANGE *pRange = NULL,
+                *pRangeNext = NULL;
+
+    if (bEnable && rpe->LoadStatus.Image)
+        return LOGICAL_FALSE;
+    if (!bEnable) {
+        for (pRange = rpe->pDirty; pRange != NULL; pRange = pRangeNext) {
+            pRangeNext = (DIRTY_RANGE*)pRange->Flink;
+            free(pRange);
+        }
+        rpe->pDirty = NULL;
+    }
+    rpe->LoadStatus.Tracked = bEnable ? TRUE : FALSE;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Writes only the ranges recorded in rpe->pDirty back to the original file, then clears them. Image
+/// aligned PEs (LoadStatus.Image) are refused, their buffer isn't laid out like the file </summary>
+///
+/// <param name="rpe">
+/// Loaded file aligned RAW_PE struct with tracking enabled </param>
+/// <param name="hFile">
+/// Handle to the file rpe was loaded from, opened with GENERIC_WRITE and FILE_SHARE_READ (PlOpenFile keeps its own handle open) </param>
+/// <param name="bChecksum">
+/// TRUE to recalculate OptionalHeader.CheckSum and write it too </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error or image aligned rpe, LOGICAL_MAYBE on CRT/file error
+/// (unwritten ranges are kept) </returns>
+LOGICAL EXPORT LIBCALL PlFlushDirty(INOUT RAW_PE* rpe, IN HANDLE hFile, IN const BOOL bChecksum) {
+    DIRTY_RANGE *pRange = NULL;
+    OVERLAPPED   ol;
+    DWORD        dwChecksum = 0,
+                 cbChunk = 0,
+                 cbWritten = 0;
+    PTR          Done = 0,
+                 Source = 0;
+
+    if (!rpe->LoadStatus.Tracked || rpe->LoadStatus.Image || hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+        return LOGICAL_FALSE;
+    // nothing to do, don't touch the checksum either
+    if (rpe->pDirty == NULL)
+        return LOGICAL_TRUE;
+    if (bChecksum) {
+        if (!LOGICAL_SUCCESS(PlCalculateChecksum(rpe, &dwChecksum)))
+            return LOGICAL_FALSE;
+        if (!LOGICAL_SUCCESS(PlWriteRva(rpe, rpe->pDosHdr->e_lfanew + offsetof(NT_HEADERS, OptionalHeader.CheckSum), &dwChecksum, sizeof(dwChecksum))))
+            return LOGICAL_MAYBE;
+    }
+    while ((pRange = rpe->pDirty) != NULL) {
+        // file alignment, so merged ranges can cross section boundaries
+        Source = (PTR)rpe->pDosHdr + pRange->Offset;
+        for (Done = 0; Done < pRange->cbSize; Done += cbWritten) {
+            cbChunk = pRange->cbSize - Done > 0x10000000 ? 0x10000000 : (DWORD)(pRange->cbSize - Done);
+            memset(&ol, 0, sizeof(ol));
+            ol.Offset = (DWORD)(pRange->Offset + Done);
+            ol.OffsetHigh = (DWORD)((uint64_t)(pRange->Offset + Done) >> 32);
+            if (!WriteFile(hFile, (LPCVOID)(Source + Done), cbChunk, &cbWritten, &ol) || !cbWritten)
+                return LOGICAL_MAYBE;
+        }
+        rpe->pDirty = (DIRTY_RANGE*)pRange->Flink;
+        free(pRange);
+    }
+    dmsg(TEXT("\nFlushed PE file at 0x%p"), rpe->pDosHdr);
+    return LOGICAL_TRUE;
+}
+
 /// <summary>
 ///	Converts Rva to virtual address </summary>
 ///
@@ -310,20 +441,278 @@ LOGICAL EXPORT LIBCALL PlMaxPa(IN const RAW_PE* rpe, OUT PTR* MaxPa) {
 /// <returns>
 /// LOGICAL_TRUE always (no error checking) </returns>
 LOGICAL EXPORT LIBCALL PlMaxRva(IN const RAW_PE* rpe, OUT PTR* MaxRva) {
-    PTR dwLargeAddr = 0;
+    PTR dwLargeAddr = 0,
+        cbVirtual = 0;
     
     *MaxRva = rpe->pNtHdr->OptionalHeader.SizeOfHeaders;
     if (!rpe->pNtHdr->FileHeader.NumberOfSections)
         return LOGICAL_TRUE;
     for (register size_t i = 0; i < rpe->pNtHdr->FileHeader.NumberOfSections; ++i) {
-        dwLargeAddr = rpe->ppSecHdr[i]->VirtualAddress + PlAlignUp(rpe->ppSecHdr[i]->Misc.VirtualSize, rpe->pNtHdr->OptionalHeader.SectionAlignment);
+        // the loader takes SizeOfRawData when VirtualSize is 0
+        cbVirtual = rpe->ppSecHdr[i]->Misc.VirtualSize ? rpe->ppSecHdr[i]->Misc.VirtualSize : rpe->ppSecHdr[i]->SizeOfRawData;
+        dwLargeAddr = rpe->ppSecHdr[i]->VirtualAddress + PlAlignUp(cbVirtual, rpe->pNtHdr->OptionalHeader.SectionAlignment);
         *MaxRva = dwLargeAddr > *MaxRva ? dwLargeAddr : *MaxRva; // max(dwLargeAddr, *MaxRva) 
     }
     return LOGICAL_TRUE;
 }
 
 /// <summary>
-///	Loads import list into rpe->pImport </summary>
+///	Gets a view of data appended after the last section of a file aligned RAW_PE. Nothing is
+/// copied or allocated, ov->pData points into the backing buffer </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE with known buffer size (PlAttachFileEx) </param>
+/// <param name="ov">
+/// Pointer to OVERLAY_VIEW that will recieve overlay info </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success (ov->cbSize may be 0), LOGICAL_FALSE if buffer size is unknown, rpe is image aligned or on PE error </returns>
+LOGICAL EXPORT LIBCALL PlGetOverlay(IN const RAW_PE* rpe, OUT OVERLAY_VIEW* ov) {
+    PTR MaxPa = 0,
+        SecurityPa = 0,
+        cbSecurity = 0;
+
+    memset(ov, 0, sizeof(*ov));
+    // images end at MaxRva, nothing was appended to them
+    if (!rpe->cbBuffer || rpe->LoadStatus.Image)
+        return LOGICAL_FALSE;
+    if (!LOGICAL_SUCCESS(PlMaxPa(rpe, &MaxPa)))
+        return LOGICAL_FALSE;
+    ov->Offset = MaxPa;
+    if (MaxPa >= rpe->cbBuffer)
+        return LOGICAL_TRUE;
+    ov->cbSize = rpe->cbBuffer - MaxPa;
+    // certificate table is addressed by file offset and gets appended by signtool, it isn't overlay
+    SecurityPa = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY].VirtualAddress;
+    cbSecurity = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY].Size;
+    if (cbSecurity && SecurityPa >= MaxPa && SecurityPa + cbSecurity == rpe->cbBuffer)
+        ov->cbSize = SecurityPa - MaxPa;
+    if (!ov->cbSize)
+        return LOGICAL_TRUE;
+    ov->pData = (void*)((PTR)rpe->pDosHdr + MaxPa);
+    ov->qwHash = PlHashData(ov->pData, ov->cbSize);
+    dmsg(TEXT("\nPE file at 0x%p has %lu bytes of overlay at %08lx"), rpe->pDosHdr, (unsigned long)ov->cbSize, (unsigned long)MaxPa);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Checks a name of the bound import directory ends inside of it </summary>
+///
+/// <returns>
+/// Name, NULL if it doesn't </returns>
+static const char* PlBoundImportName(IN const BOUND_IMPORT_DESCRIPTOR* pbidFirst, IN const PTR cbDir, IN const WORD OffsetModuleName) {
+    if (OffsetModuleName >= cbDir
+     || memchr((const char*)pbidFirst + OffsetModuleName, 0, cbDir - OffsetModuleName) == NULL)
+        return NULL;
+    return (const char*)pbidFirst + OffsetModuleName;
+}
+
+/// <summary>
+///	Finds the bound import directory, the linker puts it behind the section table. The whole directory
+/// is checked: every descriptor, forwarder ref and name has to be inside DataDirectory's Size </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+/// <param name="ppbid">
+/// Receives first descriptor, forwarder refs follow their descriptor and a zeroed descriptor ends the directory </param>
+/// <param name="pcbDir">
+/// Receives size of the directory, names are offsets into it </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there is no bound import directory or it's malformed </returns>
+LOGICAL EXPORT LIBCALL PlGetBoundImports(IN const RAW_PE* rpe, OUT BOUND_IMPORT_DESCRIPTOR** ppbid, OUT PTR* pcbDir) {
+    PTR                      Rva = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT].VirtualAddress,
+                             cbDir = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT].Size,
+                             pLast = 0;
+    BOUND_IMPORT_DESCRIPTOR *pbidFirst = NULL,
+                            *pbid = NULL;
+    BOUND_FORWARDER_REF     *pbfr = NULL;
+
+    *ppbid = NULL;
+    *pcbDir = 0;
+    if (!Rva || cbDir < sizeof(BOUND_IMPORT_DESCRIPTOR))
+        return LOGICAL_FALSE;
+    // PlGetRvaPtr only knows the headers themselves, headers are contiguous in files and images alike
+    if (Rva < rpe->pNtHdr->OptionalHeader.SizeOfHeaders) {
+        if (Rva + cbDir > rpe->pNtHdr->OptionalHeader.SizeOfHeaders)
+            return LOGICAL_FALSE;
+        pbidFirst = (BOUND_IMPORT_DESCRIPTOR*)((PTR)rpe->pDosHdr + Rva);
+    } else if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva, (PTR*)&pbidFirst))
+            || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva + cbDir - 1, &pLast))
+            || pLast - (PTR)pbidFirst != cbDir - 1)
+        return LOGICAL_FALSE;
+    for (pbid = pbidFirst; ; pbid += 1 + pbid->NumberOfModuleForwarderRefs) {
+        if ((PTR)(pbid + 1) > (PTR)pbidFirst + cbDir)
+            return LOGICAL_FALSE;
+        if (!pbid->OffsetModuleName)
+            break;
+        if ((PTR)(pbid + 1 + pbid->NumberOfModuleForwarderRefs) > (PTR)pbidFirst + cbDir
+         || PlBoundImportName(pbidFirst, cbDir, pbid->OffsetModuleName) == NULL)
+            return LOGICAL_FALSE;
+        pbfr = (BOUND_FORWARDER_REF*)(pbid + 1);
+        for (register WORD i = 0; i < pbid->NumberOfModuleForwarderRefs; ++i) {
+            if (PlBoundImportName(pbidFirst, cbDir, pbfr[i].OffsetModuleName) == NULL)
+                return LOGICAL_FALSE;
+        }
+    }
+    *ppbid = pbidFirst;
+    *pcbDir = cbDir;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Finds the data a debug directory entry describes, by rva when it is mapped and by file
+/// pointer when it isn't (debug data can sit behind the last section) </summary>
+///
+/// <returns>
+/// Pointer to the data, NULL if it is outside of the PE </returns>
+static BYTE* PlGetDebugData(IN const RAW_PE* rpe, IN const DEBUG_DIRECTORY* pdd) {
+    BYTE *pData = NULL,
+         *pLast = NULL;
+
+    if (!pdd->SizeOfData)
+        return NULL;
+    if (pdd->AddressOfRawData) {
+        if (LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pdd->AddressOfRawData, (PTR*)&pData))
+         && LOGICAL_SUCCESS(PlGetRvaPtr(rpe, pdd->AddressOfRawData + pdd->SizeOfData - 1, (PTR*)&pLast))
+         && pLast - pData == pdd->SizeOfData - 1)
+            return pData;
+    }
+    if (pdd->PointerToRawData) {
+        if (LOGICAL_SUCCESS(PlGetPaPtr(rpe, pdd->PointerToRawData, (PTR*)&pData))
+         && LOGICAL_SUCCESS(PlGetPaPtr(rpe, pdd->PointerToRawData + pdd->SizeOfData - 1, (PTR*)&pLast))
+         && pLast - pData == pdd->SizeOfData - 1)
+            return pData;
+        // outside of every section, only reachable while the buffer is file aligned (sections sit at their file offsets)
+        if (!pdd->AddressOfRawData && rpe->cbBuffer && pdd->PointerToRawData + pdd->SizeOfData <= rpe->cbBuffer
+         && rpe->pNtHdr->FileHeader.NumberOfSections
+         && (PTR)rpe->ppSectionData[0] == (PTR)rpe->pDosHdr + rpe->ppSecHdr[0]->PointerToRawData)
+            return (BYTE*)rpe->pDosHdr + pdd->PointerToRawData;
+    }
+    return NULL;
+}
+
+/// <summary>
+///	Reads the pdb identity (RSDS guid or NB10 timestamp, age and path) from the CodeView entry of the
+/// debug directory. Nothing is copied or allocated, strings point into rpe </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE, file or image (&vm->PE) </param>
+/// <param name="pcvi">
+/// Pointer to CODEVIEW_INFO that will recieve the identity </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there is no CodeView entry or it is malformed </returns>
+LOGICAL EXPORT LIBCALL PlGetCodeViewInfo(IN const RAW_PE* rpe, OUT CODEVIEW_INFO* pcvi) {
+    DEBUG_DIRECTORY *pdd = NULL,
+                    *pddLast = NULL;
+    BYTE            *pData = NULL;
+    DWORD            Rva = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].VirtualAddress,
+                     cEntries = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG].Size / sizeof(DEBUG_DIRECTORY),
+                     cbHeader = 0,
+                     cbPath = 0,
+                     i = 0;
+
+    memset(pcvi, 0, sizeof(*pcvi));
+    if (!Rva || !cEntries)
+        return LOGICAL_FALSE;
+    // whole directory has to be in one section
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva, (PTR*)&pdd))
+     || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva + (cEntries - 1) * sizeof(DEBUG_DIRECTORY), (PTR*)&pddLast))
+     || pddLast != pdd + cEntries - 1)
+        return LOGICAL_FALSE;
+    for (i = 0; i < cEntries; ++i, ++pdd) {
+        if (pdd->Type != IMAGE_DEBUG_TYPE_CODEVIEW || pdd->SizeOfData < 2 * sizeof(DWORD))
+            continue;
+        pData = PlGetDebugData(rpe, pdd);
+        if (pData == NULL)
+            continue;
+        memset(pcvi, 0, sizeof(*pcvi));
+        pcvi->dwSignature = *(DWORD*)pData;
+        if (pcvi->dwSignature == CODEVIEW_SIGNATURE_RSDS) {
+            // signature, guid, age
+            cbHeader = sizeof(DWORD) + sizeof(GUID) + sizeof(DWORD);
+            if (pdd->SizeOfData <= cbHeader)
+                continue;
+            memcpy(&pcvi->Guid, pData + sizeof(DWORD), sizeof(GUID));
+            pcvi->dwAge = *(DWORD*)(pData + sizeof(DWORD) + sizeof(GUID));
+        } else if (pcvi->dwSignature == CODEVIEW_SIGNATURE_NB10) {
+            // signature, offset, timestamp, age
+            cbHeader = 4 * sizeof(DWORD);
+            if (pdd->SizeOfData <= cbHeader)
+                continue;
+            pcvi->dwTimeStamp = *(DWORD*)(pData + 2 * sizeof(DWORD));
+            pcvi->dwAge = *(DWORD*)(pData + 3 * sizeof(DWORD));
+        } else
+            continue;
+        // path has to end inside the record
+        for (cbPath = cbHeader; cbPath < pdd->SizeOfData && pData[cbPath]; ++cbPath);
+        if (cbPath == pdd->SizeOfData)
+            continue;
+        pcvi->szPdbPath = (const char*)pData + cbHeader;
+        pcvi->pddEntry = pdd;
+        return LOGICAL_TRUE;
+    }
+    memset(pcvi, 0, sizeof(*pcvi));
+    return LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Looks a library up in the bound import directory </summary>
+///
+/// <returns>
+/// TimeDateStamp it was bound against, 0 if it isn't there </returns>
+static DWORD PlBoundTimeDateStamp(IN const BOUND_IMPORT_DESCRIPTOR* pbidFirst, IN const PTR cbDir, IN const char* szLibrary) {
+    const BOUND_IMPORT_DESCRIPTOR *pbid = NULL;
+
+    if (pbidFirst == NULL)
+        return 0;
+    // PlGetBoundImports checked the directory, stay inside it anyway
+    for (pbid = pbidFirst; (PTR)(pbid + 1) <= (PTR)pbidFirst + cbDir && pbid->OffsetModuleName; pbid += 1 + pbid->NumberOfModuleForwarderRefs) {
+        if (!lstrcmpiA((const char*)pbidFirst + pbid->OffsetModuleName, szLibrary))
+            return pbid->TimeDateStamp;
+    }
+    return 0;
+}
+
+/// <summary>
+///	Fills an import library's items from its name table, item slots are the matching iat entries </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlEnumerateThunks(IN const RAW_PE* rpe, INOUT IMPORT_LIBRARY* pImport, IN THUNK_DATA* tdNames, IN THUNK_DATA* tdIat, IN const PTR Bias) {
+    IMPORT_NAME *inName = NULL;
+    IMPORT_ITEM *pII = NULL;
+
+    pII = calloc(1, sizeof(*pII));
+    if (pII == NULL)
+        return LOGICAL_MAYBE;
+    pImport->iiImportList = pII;
+    for (; tdNames->u1.Function; ++tdNames, ++tdIat) {
+        if (tdNames->u1.Ordinal & IMAGE_ORDINAL_FLAG)
+            pII->Ordinal = (char*)LOWORD(tdNames->u1.Ordinal);
+        else {
+            inName = (IMPORT_NAME*)((PTR)tdNames->u1.AddressOfData - Bias);
+            if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)inName, (PTR*)&inName)))
+                return LOGICAL_FALSE;
+            pII->Name = (char*)inName->Name;
+            pII->Hint = inName->Hint;
+        }
+        pII->dwItemPtr = (PTR*)&tdIat->u1.AddressOfData;
+        if (tdNames[1].u1.Function) {
+            pII->Flink = calloc(1, sizeof(IMPORT_ITEM));
+            if (pII->Flink == NULL)
+                return LOGICAL_MAYBE;
+            pII = (IMPORT_ITEM*)pII->Flink;
+        }
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Loads import list into rpe->pImport, delay loaded libraries come after the regular ones. Their
+/// pDelayDesc is set, callers resolving imports themselves should skip them (or resolve them through
+/// the delay IAT on demand) </summary>
 ///
 /// <param name="rpe">
 /// Loaded RAW_PE </param>
@@ -331,59 +720,76 @@ LOGICAL EXPORT LIBCALL PlMaxRva(IN const RAW_PE* rpe, OUT PTR* MaxRva) {
 /// <returns>
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
 LOGICAL EXPORT LIBCALL PlEnumerateImports(INOUT RAW_PE* rpe) {
-    IMPORT_DESCRIPTOR   *iidDesc = NULL;
-    THUNK_DATA        *tdIat = NULL;
-    IMPORT_NAME         *inName = NULL;
-    IMPORT_LIBRARY    *pImport = NULL;
-    IMPORT_ITEM       *pII = NULL;
+    IMPORT_DESCRIPTOR       *iidDesc = NULL;
+    DELAY_IMPORT_DESCRIPTOR *didDesc = NULL;
+    THUNK_DATA              *tdIat = NULL,
+                            *tdNames = NULL;
+    IMPORT_LIBRARY         **ppImport = &rpe->pImport;
+    BOUND_IMPORT_DESCRIPTOR *pbidFirst = NULL;
+    PTR                      cbBound = 0,
+                             Bias = 0;
+    LOGICAL                  lResult = LOGICAL_FALSE;
     
+    PlGetBoundImports(rpe, &pbidFirst, &cbBound);
     // do we even have to do imports?
-    if (!rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size
-     && !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress)
-        return LOGICAL_TRUE;
-    rpe->pImport = calloc(1, sizeof(*rpe->pImport));
-    if (rpe->pImport == NULL)
-        return LOGICAL_MAYBE;
-    pImport = rpe->pImport;
-    iidDesc = (IMPORT_DESCRIPTOR*)((PTR)rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress);
-    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)iidDesc, (PTR*)&iidDesc)))
-        return LOGICAL_FALSE;
-    for (; iidDesc->Characteristics; ++iidDesc) {
-        pImport->Library = (char*)iidDesc->Name;
-        if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)pImport->Library, (PTR*)&pImport->Library)))
-            return LOGICAL_FALSE;
-        tdIat = (THUNK_DATA*)iidDesc->FirstThunk;
-        if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)tdIat, (PTR*)&tdIat)))
+    if (rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size
+     || rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress) {
+        iidDesc = (IMPORT_DESCRIPTOR*)((PTR)rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress);
+        if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)iidDesc, (PTR*)&iidDesc)))
             return LOGICAL_FALSE;
-        pII = calloc(1, sizeof(*pII));
-        if (pII == NULL)
-            return LOGICAL_MAYBE;
-        pImport->iiImportList = pII;
-        for (; tdIat->u1.Function; ++tdIat) {
-            if (tdIat->u1.Ordinal & IMAGE_ORDINAL_FLAG)
-                pII->Ordinal = (char*)LOWORD(tdIat->u1.Ordinal);
-            else {
-                inName = (IMPORT_NAME*)tdIat->u1.AddressOfData;
-                if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)inName, (PTR*)&inName)))
-                    return LOGICAL_FALSE;
-                pII->Name = (char*)inName->Name;
-            }
-            pII->dwItemPtr = (PTR*)&tdIat->u1.AddressOfData;
-            THUNK_DATA* tdNext = tdIat + 1;
-            if (tdNext->u1.Function) {
-                pII->Flink = calloc(1, sizeof(IMPORT_ITEM));
-                if (pII->Flink == NULL)
-                    return LOGICAL_MAYBE;
-                pII = (IMPORT_ITEM*)pII->Flink;
-            }
-        }
-        if (iidDesc[1].Characteristics) {   // check if next item is there (to allocate)
-            pImport->Flink = calloc(1, sizeof(IMPORT_LIBRARY));   // fix extra allocation issue
-            if (pImport->Flink == NULL)
+        // OriginalFirstThunk can be 0 (old borland), the name can't
+        for (; iidDesc->Name; ++iidDesc) {
+            *ppImport = calloc(1, sizeof(**ppImport));
+            if (*ppImport == NULL)
                 return LOGICAL_MAYBE;
-            pImport = (IMPORT_LIBRARY*)pImport->Flink;
+            (*ppImport)->Library = (char*)iidDesc->Name;
+            if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)(*ppImport)->Library, (PTR*)&(*ppImport)->Library)))
+                return LOGICAL_FALSE;
+            tdIat = (THUNK_DATA*)iidDesc->FirstThunk;
+            if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)tdIat, (PTR*)&tdIat)))
+                return LOGICAL_FALSE;
+            // bound or loaded iats hold addresses, the names are only left in the ilt
+            tdNames = tdIat;
+            if (iidDesc->OriginalFirstThunk && !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, iidDesc->OriginalFirstThunk, (PTR*)&tdNames)))
+                return LOGICAL_FALSE;
+            (*ppImport)->ptdNames = tdNames;
+            (*ppImport)->ptdIat = tdIat;
+            // -1 is new style binding, the real stamp is in the bound import directory
+            if (iidDesc->TimeDateStamp == (DWORD)-1)
+                (*ppImport)->BoundTimeDateStamp = PlBoundTimeDateStamp(pbidFirst, cbBound, (*ppImport)->Library);
+            else
+                (*ppImport)->BoundTimeDateStamp = iidDesc->TimeDateStamp;
+            lResult = PlEnumerateThunks(rpe, *ppImport, tdNames, tdIat, 0);
+            if (!LOGICAL_SUCCESS(lResult))
+                return lResult;
+            ppImport = (IMPORT_LIBRARY**)&(*ppImport)->Flink;
         }
     }
+    if (!rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT].Size
+     && !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT].VirtualAddress)
+        return LOGICAL_TRUE;
+    didDesc = (DELAY_IMPORT_DESCRIPTOR*)((PTR)rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT].VirtualAddress);
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)didDesc, (PTR*)&didDesc)))
+        return LOGICAL_FALSE;
+    for (; didDesc->DllNameRva; ++didDesc) {
+        // old (vc6) descriptors hold VAs instead of RVAs, including in their name tables
+        Bias = didDesc->Attributes & DELAY_ATTRIBUTE_RVA ? 0 : rpe->pNtHdr->OptionalHeader.ImageBase;
+        *ppImport = calloc(1, sizeof(**ppImport));
+        if (*ppImport == NULL)
+            return LOGICAL_MAYBE;
+        (*ppImport)->pDelayDesc = didDesc;
+        if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, didDesc->DllNameRva - Bias, (PTR*)&(*ppImport)->Library))
+         || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, didDesc->ImportNameTableRva - Bias, (PTR*)&tdNames))
+         || !LOGICAL_SUCCESS(PlGetRvaPtr(rpe, didDesc->ImportAddressTableRva - Bias, (PTR*)&tdIat)))
+            return LOGICAL_FALSE;
+        (*ppImport)->ptdNames = tdNames;
+        (*ppImport)->ptdIat = tdIat;
+        (*ppImport)->BoundTimeDateStamp = didDesc->TimeDateStamp;
+        lResult = PlEnumerateThunks(rpe, *ppImport, tdNames, tdIat, Bias);
+        if (!LOGICAL_SUCCESS(lResult))
+            return lResult;
+        ppImport = (IMPORT_LIBRARY**)&(*ppImport)->Flink;
+    }
     return LOGICAL_TRUE;
 }
 
@@ -40,6 +40,10 @@
     LOGICAL EXPORT LIBCALL PlWritePa(INOUT RAW_PE* rpe, IN const PTR Pa, IN const void* pData, IN size_t cbData);
     LOGICAL EXPORT LIBCALL PlReadPa(IN const RAW_PE* rpe, IN const PTR Pa, IN void* pBuffer, IN size_t cbBufferMax);
 
+    // incremental saving, only what PlWriteXxx touched
+    LOGICAL EXPORT LIBCALL PlTrackDirty(INOUT RAW_PE* rpe, IN const BOOL bEnable);
+    LOGICAL EXPORT LIBCALL PlFlushDirty(INOUT RAW_PE* rpe, IN HANDLE hFile, IN const BOOL bChecksum);
+
     // virtual to rva... come on, guys?
     LOGICAL EXPORT LIBCALL PlRvaToVa(IN const VIRTUAL_MODULE* vm, IN const PTR Rva, OUT PTR* Va);
     LOGICAL EXPORT LIBCALL PlPaToVa(IN const VIRTUAL_MODULE* vm, IN const PTR Pa, OUT PTR* Va);
@@ -47,10 +51,17 @@
     // fact checking?
     LOGICAL EXPORT LIBCALL PlMaxPa(IN const RAW_PE* rpe, OUT PTR* MaxPa);
     LOGICAL EXPORT LIBCALL PlMaxRva(IN const RAW_PE* rpe, OUT PTR* MaxRva);
+
+    // data appended to file
+    LOGICAL EXPORT LIBCALL PlGetOverlay(IN const RAW_PE* rpe, OUT OVERLAY_VIEW* ov);
     
     // imports/exports
     LOGICAL EXPORT LIBCALL PlEnumerateImports(INOUT RAW_PE* rpe);
     LOGICAL EXPORT LIBCALL PlFreeEnumeratedImports(INOUT RAW_PE* rpe);
+    LOGICAL EXPORT LIBCALL PlGetBoundImports(IN const RAW_PE* rpe, OUT BOUND_IMPORT_DESCRIPTOR** ppbid, OUT PTR* pcbDir);
+
+    // debug info
+    LOGICAL EXPORT LIBCALL PlGetCodeViewInfo(IN const RAW_PE* rpe, OUT CODEVIEW_INFO* pcvi);
 
     LOGICAL EXPORT LIBCALL PlEnumerateExports(INOUT RAW_PE* rpe);
     LOGICAL EXPORT LIBCALL PlFreeEnumeratedExports(INOUT RAW_PE* rpe);
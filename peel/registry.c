@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "registry.h"
+
+/// <summary>
+///	Lowercases a module name into szKey (MAX_PATH chars) </summary>
+///
+/// <returns>
+/// Length of name, 0 if it's empty or doesn't fit </returns>
+static size_t PlLowerName(IN const char* szName, OUT char* szKey) {
+    size_t cchName = 0;
+
+    for (; szName[cchName]; ++cchName) {
+        if (cchName + 1 >= MAX_PATH)
+            return 0;
+        szKey[cchName] = szName[cchName] >= 'A' && szName[cchName] <= 'Z' ? szName[cchName] + 'a' - 'A' : szName[cchName];
+    }
+    szKey[cchName] = '\0';
+    return cchName;
+}
+
+/// <summary>
+///	Bases are allocation granularity aligned, the low 16 bits carry nothing </summary>
+static size_t PlBaseBucket(IN const PTR Base) {
+    return (size_t)(Base >> 16) & (REGISTRY_BUCKETS - 1);
+}
+
+/// <summary>
+///	Binary searches the sorted ranges </summary>
+///
+/// <returns>
+/// Index of first module based above Address (cModules if there is none) </returns>
+static size_t PlUpperRange(IN const MODULE_REGISTRY* reg, IN const PTR Address) {
+    size_t iLow = 0,
+           iHigh = reg->cModules,
+           iMid = 0;
+
+    while (iLow < iHigh) {
+        iMid = iLow + (iHigh - iLow) / 2;
+        if (reg->ppRanges[iMid]->Base <= Address)
+            iLow = iMid + 1;
+        else
+            iHigh = iMid;
+    }
+    return iLow;
+}
+
+/// <summary>
+///	Unlinks an entry from both buckets and the ranges and frees it, lock must be held </summary>
+static void PlRemoveEntry(INOUT MODULE_REGISTRY* reg, INOUT MODULE_ENTRY* pme) {
+    MODULE_ENTRY **ppLink = NULL;
+    size_t         iRange = PlUpperRange(reg, pme->Base) - 1;
+
+    for (ppLink = &reg->pByName[pme->qwNameHash & (REGISTRY_BUCKETS - 1)]; *ppLink != pme; ppLink = (MODULE_ENTRY**)&(*ppLink)->NameFlink)
+        ;
+    *ppLink = (MODULE_ENTRY*)pme->NameFlink;
+    for (ppLink = &reg->pByBase[PlBaseBucket(pme->Base)]; *ppLink != pme; ppLink = (MODULE_ENTRY**)&(*ppLink)->BaseFlink)
+        ;
+    *ppLink = (MODULE_ENTRY*)pme->BaseFlink;
+    memmove(&reg->ppRanges[iRange], &reg->ppRanges[iRange + 1], (reg->cModules - iRange - 1) * sizeof(*reg->ppRanges));
+    --reg->cModules;
+    free(pme->Name);
+    free(pme);
+}
+
+/// <summary>
+///	Registers a loaded image under a module name, if the name is already registered
+/// the existing entry's reference count is bumped instead (like LoadLibrary) </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="szName">
+/// Module name, case insensitive </param>
+/// <param name="vm">
+/// Loaded VIRTUAL_MODULE, gets ctx as its context if it had none </param>
+/// <param name="ppme">
+/// Receives the entry, check (*ppme)->vm to see whether vm was registered or an earlier module was returned </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if the name is invalid or vm overlaps a registered module, 
+/// LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlRegisterModule(INOUT PEEL_CONTEXT* ctx, IN const char* szName, IN VIRTUAL_MODULE* vm, OUT MODULE_ENTRY** ppme) {
+    MODULE_REGISTRY  *reg = &ctx->Registry;
+    MODULE_ENTRY     *pme = NULL,
+                    **ppRanges = NULL;
+    char              szKey[MAX_PATH];
+    size_t            cchKey = PlLowerName(szName, szKey),
+                      cbImage = 0,
+                      iRange = 0;
+    PTR64             qwHash = 0;
+    PTR               Base = (PTR)vm->pBaseAddr;
+
+    *ppme = NULL;
+    if (!cchKey || vm->PE.pNtHdr == NULL)
+        return LOGICAL_FALSE;
+    cbImage = vm->PE.pNtHdr->OptionalHeader.SizeOfImage;
+    if (!cbImage)
+        return LOGICAL_FALSE;
+    qwHash = PlHashData(szKey, cchKey);
+    EnterCriticalSection(&ctx->csLock);
+    for (pme = reg->pByName[qwHash & (REGISTRY_BUCKETS - 1)]; pme != NULL; pme = (MODULE_ENTRY*)pme->NameFlink) {
+        if (pme->qwNameHash == qwHash && !strcmp(pme->Name, szKey)) {
+            ++pme->cRefs;
+            LeaveCriticalSection(&ctx->csLock);
+            *ppme = pme;
+            return LOGICAL_TRUE;
+        }
+    }
+    // neighbours in the sorted ranges are the only ones that can overlap
+    iRange = PlUpperRange(reg, Base);
+    if ((iRange && reg->ppRanges[iRange - 1]->Base + reg->ppRanges[iRange - 1]->cbImage > Base)
+     || (iRange < reg->cModules && reg->ppRanges[iRange]->Base < Base + cbImage)) {
+        LeaveCriticalSection(&ctx->csLock);
+        dmsg(TEXT("\n%hs at 0x%p overlaps a registered module"), szKey, vm->pBaseAddr);
+        return LOGICAL_FALSE;
+    }
+    if (reg->cModules == reg->cMaxModules) {
+        ppRanges = malloc((reg->cMaxModules ? reg->cMaxModules * 2 : 0x10) * sizeof(*ppRanges));
+        if (ppRanges == NULL) {
+            LeaveCriticalSection(&ctx->csLock);
+            return LOGICAL_MAYBE;
+        }
+        if (reg->ppRanges != NULL) {
+            memcpy(ppRanges, reg->ppRanges, reg->cModules * sizeof(*ppRanges));
+            free(reg->ppRanges);
+        }
+        reg->ppRanges = ppRanges;
+        reg->cMaxModules = reg->cMaxModules ? reg->cMaxModules * 2 : 0x10;
+    }
+    pme = calloc(1, sizeof(*pme));
+    if (pme == NULL || (pme->Name = malloc(cchKey + 1)) == NULL) {
+        LeaveCriticalSection(&ctx->csLock);
+        if (pme != NULL)
+            free(pme);
+        return LOGICAL_MAYBE;
+    }
+    memcpy(pme->Name, szKey, cchKey + 1);
+    pme->qwNameHash = qwHash;
+    pme->vm = vm;
+    pme->Base = Base;
+    pme->cbImage = cbImage;
+    pme->cRefs = 1;
+    pme->NameFlink = reg->pByName[qwHash & (REGISTRY_BUCKETS - 1)];
+    reg->pByName[qwHash & (REGISTRY_BUCKETS - 1)] = pme;
+    pme->BaseFlink = reg->pByBase[PlBaseBucket(Base)];
+    reg->pByBase[PlBaseBucket(Base)] = pme;
+    memmove(&reg->ppRanges[iRange + 1], &reg->ppRanges[iRange], (reg->cModules - iRange) * sizeof(*reg->ppRanges));
+    reg->ppRanges[iRange] = pme;
+    ++reg->cModules;
+    // so PlFreeImage/PlDetachImage unregister it
+    if (vm->PE.pContext == NULL)
+        vm->PE.pContext = ctx;
+    LeaveCriticalSection(&ctx->csLock);
+    dmsg(TEXT("\nRegistered %hs at 0x%p"), pme->Name, vm->pBaseAddr);
+    *ppme = pme;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Drops a reference to a registered module, the entry is removed with the last one.
+/// The image itself is left alone </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="pme">
+/// Entry from PlRegisterModule or PlFindModule* </param>
+/// <param name="pbRemoved">
+/// Receives TRUE if that was the last reference and the image can be freed (can be NULL) </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlReleaseModule(INOUT PEEL_CONTEXT* ctx, INOUT MODULE_ENTRY* pme, OUT OPT BOOL* pbRemoved) {
+    BOOL bRemoved = FALSE;
+
+    EnterCriticalSection(&ctx->csLock);
+    if (!--pme->cRefs) {
+        PlRemoveEntry(&ctx->Registry, pme);
+        bRemoved = TRUE;
+    }
+    LeaveCriticalSection(&ctx->csLock);
+    if (pbRemoved != NULL)
+        *pbRemoved = bRemoved;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Removes whatever entry refers to vm regardless of its references, called when images are freed </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="vm">
+/// VIRTUAL_MODULE that's going away </param>
+///
+/// <returns>
+/// LOGICAL_TRUE if an entry was removed, LOGICAL_FALSE if vm wasn't registered </returns>
+LOGICAL EXPORT LIBCALL PlUnregisterImage(INOUT PEEL_CONTEXT* ctx, IN const VIRTUAL_MODULE* vm) {
+    MODULE_ENTRY *pme = NULL;
+
+    EnterCriticalSection(&ctx->csLock);
+    for (pme = ctx->Registry.pByBase[PlBaseBucket((PTR)vm->pBaseAddr)]; pme != NULL; pme = (MODULE_ENTRY*)pme->BaseFlink) {
+        if (pme->vm == vm) {
+            PlRemoveEntry(&ctx->Registry, pme);
+            LeaveCriticalSection(&ctx->csLock);
+            return LOGICAL_TRUE;
+        }
+    }
+    LeaveCriticalSection(&ctx->csLock);
+    return LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Looks up a registered module by name </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="szName">
+/// Module name, case insensitive </param>
+/// <param name="ppme">
+/// Receives the entry, the reference count isn't touched </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if no module has that name </returns>
+LOGICAL EXPORT LIBCALL PlFindModule(INOUT PEEL_CONTEXT* ctx, IN const char* szName, OUT MODULE_ENTRY** ppme) {
+    MODULE_ENTRY *pme = NULL;
+    char          szKey[MAX_PATH];
+    size_t        cchKey = PlLowerName(szName, szKey);
+    PTR64         qwHash = 0;
+
+    *ppme = NULL;
+    if (!cchKey)
+        return LOGICAL_FALSE;
+    qwHash = PlHashData(szKey, cchKey);
+    EnterCriticalSection(&ctx->csLock);
+    for (pme = ctx->Registry.pByName[qwHash & (REGISTRY_BUCKETS - 1)]; pme != NULL; pme = (MODULE_ENTRY*)pme->NameFlink) {
+        if (pme->qwNameHash == qwHash && !strcmp(pme->Name, szKey)) {
+            *ppme = pme;
+            break;
+        }
+    }
+    LeaveCriticalSection(&ctx->csLock);
+    return *ppme != NULL ? LOGICAL_TRUE : LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Looks up a registered module by its base </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="Base">
+/// Base address of image (HMODULE) </param>
+/// <param name="ppme">
+/// Receives the entry, the reference count isn't touched </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if no module is based there </returns>
+LOGICAL EXPORT LIBCALL PlFindModuleByBase(INOUT PEEL_CONTEXT* ctx, IN const PTR Base, OUT MODULE_ENTRY** ppme) {
+    MODULE_ENTRY *pme = NULL;
+
+    *ppme = NULL;
+    EnterCriticalSection(&ctx->csLock);
+    for (pme = ctx->Registry.pByBase[PlBaseBucket(Base)]; pme != NULL; pme = (MODULE_ENTRY*)pme->BaseFlink) {
+        if (pme->Base == Base) {
+            *ppme = pme;
+            break;
+        }
+    }
+    LeaveCriticalSection(&ctx->csLock);
+    return *ppme != NULL ? LOGICAL_TRUE : LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Finds the registered module an address lies in, O(log n) over the sorted ranges </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+/// <param name="Address">
+/// Any address </param>
+/// <param name="ppme">
+/// Receives the entry, the reference count isn't touched </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if Address isn't inside a registered image </returns>
+LOGICAL EXPORT LIBCALL PlFindModuleByAddress(INOUT PEEL_CONTEXT* ctx, IN const PTR Address, OUT MODULE_ENTRY** ppme) {
+    MODULE_REGISTRY *reg = &ctx->Registry;
+    size_t           iRange = 0;
+
+    *ppme = NULL;
+    EnterCriticalSection(&ctx->csLock);
+    iRange = PlUpperRange(reg, Address);
+    if (iRange && Address - reg->ppRanges[iRange - 1]->Base < reg->ppRanges[iRange - 1]->cbImage)
+        *ppme = reg->ppRanges[iRange - 1];
+    LeaveCriticalSection(&ctx->csLock);
+    return *ppme != NULL ? LOGICAL_TRUE : LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Removes every entry, registered images are left alone </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlFreeRegistry(INOUT PEEL_CONTEXT* ctx) {
+    MODULE_REGISTRY *reg = &ctx->Registry;
+
+    EnterCriticalSection(&ctx->csLock);
+    for (register size_t i = 0; i < reg->cModules; ++i) {
+        free(reg->ppRanges[i]->Name);
+        free(reg->ppRanges[i]);
+    }
+    if (reg->ppRanges != NULL)
+        free(reg->ppRanges);
+    memset(reg, 0, sizeof(*reg));
+    LeaveCriticalSection(&ctx->csLock);
+    return LOGICAL_TRUE;
+}
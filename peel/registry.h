@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "peel.h"
+
+#pragma region Registry functions
+    // names are ascii and case insensitive, entries stay valid until released
+    LOGICAL EXPORT LIBCALL PlRegisterModule(INOUT PEEL_CONTEXT* ctx, IN const char* szName, IN VIRTUAL_MODULE* vm, OUT MODULE_ENTRY** ppme);
+    LOGICAL EXPORT LIBCALL PlReleaseModule(INOUT PEEL_CONTEXT* ctx, INOUT MODULE_ENTRY* pme, OUT OPT BOOL* pbRemoved);
+    LOGICAL EXPORT LIBCALL PlUnregisterImage(INOUT PEEL_CONTEXT* ctx, IN const VIRTUAL_MODULE* vm);
+
+    LOGICAL EXPORT LIBCALL PlFindModule(INOUT PEEL_CONTEXT* ctx, IN const char* szName, OUT MODULE_ENTRY** ppme);
+    LOGICAL EXPORT LIBCALL PlFindModuleByBase(INOUT PEEL_CONTEXT* ctx, IN const PTR Base, OUT MODULE_ENTRY** ppme);
+    LOGICAL EXPORT LIBCALL PlFindModuleByAddress(INOUT PEEL_CONTEXT* ctx, IN const PTR Address, OUT MODULE_ENTRY** ppme);
+
+    LOGICAL EXPORT LIBCALL PlFreeRegistry(INOUT PEEL_CONTEXT* ctx);
+#pragma endregion
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "resource.h"
+#include "raw.h"
+
+/// <summary>
+///	Gets a subdirectory of the resource tree, checking that it and its entries fit in the
+/// resource directory </summary>
+///
+/// <returns>
+/// Pointer to directory, NULL if out of bounds </returns>
+static RESOURCE_DIRECTORY* PlResourceSubdirectory(IN const RESOURCE_DIRECTORY* prdRoot, IN const PTR cbRoot, IN const DWORD dwOffset) {
+    RESOURCE_DIRECTORY *prdSub = NULL;
+    DWORD               dwDirOffset = dwOffset & ~IMAGE_RESOURCE_DATA_IS_DIRECTORY;
+
+    if ((PTR)dwDirOffset + sizeof(RESOURCE_DIRECTORY) > cbRoot)
+        return NULL;
+    prdSub = (RESOURCE_DIRECTORY*)((PTR)prdRoot + dwDirOffset);
+    if ((PTR)dwDirOffset + sizeof(RESOURCE_DIRECTORY) + ((PTR)prdSub->NumberOfNamedEntries + prdSub->NumberOfIdEntries) * sizeof(RESOURCE_DIRECTORY_ENTRY) > cbRoot)
+        return NULL;
+    return prdSub;
+}
+
+/// <summary>
+///	Fills rl from the three entries that lead to a resource </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error </returns>
+static LOGICAL PlFillResource(IN const RAW_PE* rpe, IN const RESOURCE_DIRECTORY* prdRoot, IN const PTR cbRoot, 
+                              IN const RESOURCE_DIRECTORY_ENTRY* prdeType, IN const RESOURCE_DIRECTORY_ENTRY* prdeName, IN const RESOURCE_DIRECTORY_ENTRY* prdeLang,
+                              OUT RESOURCE_LIST* rl) {
+    RESOURCE_DATA_ENTRY *prdeData = NULL;
+    PTR                  pLast = 0;
+
+    memset(rl, 0, sizeof(*rl));
+    if (prdeLang->OffsetToData & IMAGE_RESOURCE_DATA_IS_DIRECTORY
+     || (PTR)prdeLang->OffsetToData + sizeof(RESOURCE_DATA_ENTRY) > cbRoot)
+        return LOGICAL_FALSE;
+    // names are counted unicode strings relative to the root, ids are in the low WORD
+    if (prdeType->Name & IMAGE_RESOURCE_NAME_IS_STRING) {
+        if ((PTR)(prdeType->Name & ~IMAGE_RESOURCE_NAME_IS_STRING) + sizeof(WORD) > cbRoot)
+            return LOGICAL_FALSE;
+        rl->TypeName = (RESOURCE_DIR_STRING*)((PTR)prdRoot + (prdeType->Name & ~IMAGE_RESOURCE_NAME_IS_STRING));
+    } else
+        rl->dwType = LOWORD(prdeType->Name);
+    if (prdeName->Name & IMAGE_RESOURCE_NAME_IS_STRING) {
+        if ((PTR)(prdeName->Name & ~IMAGE_RESOURCE_NAME_IS_STRING) + sizeof(WORD) > cbRoot)
+            return LOGICAL_FALSE;
+        rl->Name = (RESOURCE_DIR_STRING*)((PTR)prdRoot + (prdeName->Name & ~IMAGE_RESOURCE_NAME_IS_STRING));
+    } else
+        rl->wId = LOWORD(prdeName->Name);
+    rl->wLang = LOWORD(prdeLang->Name);
+    prdeData = (RESOURCE_DATA_ENTRY*)((PTR)prdRoot + prdeLang->OffsetToData);
+    rl->cbSize = prdeData->Size;
+    rl->dwCodePage = prdeData->CodePage;
+    // data is an rva, not an offset into the directory
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, prdeData->OffsetToData, (PTR*)&rl->pData)))
+        return LOGICAL_FALSE;
+    // all of it has to be in the same section
+    if (rl->cbSize
+     && (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, (PTR)prdeData->OffsetToData + rl->cbSize - 1, &pLast))
+      || pLast - (PTR)rl->pData != rl->cbSize - 1)) {
+        rl->pData = NULL;
+        return LOGICAL_FALSE;
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Binary searches the id entries of a resource directory (they follow the named entries
+/// and are sorted ascending) </summary>
+///
+/// <returns>
+/// Pointer to entry, NULL if not found </returns>
+static RESOURCE_DIRECTORY_ENTRY* PlFindResourceEntry(IN const RESOURCE_DIRECTORY* prdDir, IN const PTR wId) {
+    RESOURCE_DIRECTORY_ENTRY *prdeIds = (RESOURCE_DIRECTORY_ENTRY*)(prdDir + 1) + prdDir->NumberOfNamedEntries;
+    size_t                    iLow = 0,
+                              iHigh = prdDir->NumberOfIdEntries;
+
+    while (iLow < iHigh) {
+        size_t iMid = iLow + (iHigh - iLow) / 2;
+        if (LOWORD(prdeIds[iMid].Name) == LOWORD(wId))
+            return &prdeIds[iMid];
+        if (LOWORD(prdeIds[iMid].Name) < LOWORD(wId))
+            iLow = iMid + 1;
+        else
+            iHigh = iMid;
+    }
+    return NULL;
+}
+
+/// <summary>
+///	Starts walking the resource tree and gets the first resource. The tree is walked in place,
+/// nothing is allocated </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+/// <param name="ri">
+/// Pointer to RESOURCE_ITERATOR that keeps position, pass to PlNextResource </param>
+/// <param name="rl">
+/// Pointer to RESOURCE_LIST that will recieve first resource (Flink is not used) </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there are no resources or on PE error </returns>
+LOGICAL EXPORT LIBCALL PlFirstResource(IN const RAW_PE* rpe, OUT RESOURCE_ITERATOR* ri, OUT RESOURCE_LIST* rl) {
+
+    memset(ri, 0, sizeof(*ri));
+    ri->iDepth = -1;
+    // do we even have resources?
+    if (!rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size
+     || !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress)
+        return LOGICAL_FALSE;
+    ri->rpe = rpe;
+    ri->cbRoot = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size;
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress, (PTR*)&ri->prdRoot)))
+        return LOGICAL_FALSE;
+    if (PlResourceSubdirectory(ri->prdRoot, ri->cbRoot, 0) == NULL)
+        return LOGICAL_FALSE;
+    ri->prdeLevel[0] = (RESOURCE_DIRECTORY_ENTRY*)(ri->prdRoot + 1);
+    ri->dwLeft[0] = ri->prdRoot->NumberOfNamedEntries + ri->prdRoot->NumberOfIdEntries;
+    ri->iDepth = 0;
+    return PlNextResource(ri, rl);
+}
+
+/// <summary>
+///	Gets the next resource from the tree (type, then name, then language order) </summary>
+///
+/// <param name="ri">
+/// Pointer to RESOURCE_ITERATOR filled by PlFirstResource </param>
+/// <param name="rl">
+/// Pointer to RESOURCE_LIST that will recieve resource (Flink is not used) </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE when there are no more resources </returns>
+LOGICAL EXPORT LIBCALL PlNextResource(INOUT RESOURCE_ITERATOR* ri, OUT RESOURCE_LIST* rl) {
+    RESOURCE_DIRECTORY       *prdSub = NULL;
+    RESOURCE_DIRECTORY_ENTRY *prdeCurr = NULL;
+
+    while (ri->iDepth >= 0) {
+        if (!ri->dwLeft[ri->iDepth]) {
+            // level is done, pop and move past the entry that led here
+            if (--ri->iDepth >= 0) {
+                ++ri->prdeLevel[ri->iDepth];
+                --ri->dwLeft[ri->iDepth];
+            }
+            continue;
+        }
+        prdeCurr = ri->prdeLevel[ri->iDepth];
+        if (ri->iDepth < 2) {
+            // type and name levels must point to directories, skip anything else
+            if (!(prdeCurr->OffsetToData & IMAGE_RESOURCE_DATA_IS_DIRECTORY)
+             || (prdSub = PlResourceSubdirectory(ri->prdRoot, ri->cbRoot, prdeCurr->OffsetToData)) == NULL) {
+                dmsg(TEXT("\nSkipping malformed resource directory entry at 0x%p"), prdeCurr);
+                ++ri->prdeLevel[ri->iDepth];
+                --ri->dwLeft[ri->iDepth];
+                continue;
+            }
+            ++ri->iDepth;
+            ri->prdeLevel[ri->iDepth] = (RESOURCE_DIRECTORY_ENTRY*)(prdSub + 1);
+            ri->dwLeft[ri->iDepth] = prdSub->NumberOfNamedEntries + prdSub->NumberOfIdEntries;
+            continue;
+        }
+        ++ri->prdeLevel[2];
+        --ri->dwLeft[2];
+        if (LOGICAL_SUCCESS(PlFillResource(ri->rpe, ri->prdRoot, ri->cbRoot, ri->prdeLevel[0], ri->prdeLevel[1], prdeCurr, rl)))
+            return LOGICAL_TRUE;
+        dmsg(TEXT("\nSkipping malformed resource data entry at 0x%p"), prdeCurr);
+    }
+    return LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Finds a resource by id, only descending the branches that lead to it </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+/// <param name="dwType">
+/// Resource type id (RT_XXX) </param>
+/// <param name="wId">
+/// Resource id </param>
+/// <param name="wLang">
+/// Language id, RESOURCE_ANY_LANGUAGE to take the first one </param>
+/// <param name="rl">
+/// Pointer to RESOURCE_LIST that will recieve resource (Flink is not used) </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if not found or on PE error </returns>
+LOGICAL EXPORT LIBCALL PlFindResource(IN const RAW_PE* rpe, IN const PTR dwType, IN const PTR wId, IN const PTR wLang, OUT RESOURCE_LIST* rl) {
+    RESOURCE_DIRECTORY       *prdRoot = NULL,
+                             *prdName = NULL,
+                             *prdLang = NULL;
+    RESOURCE_DIRECTORY_ENTRY *prdeType = NULL,
+                             *prdeName = NULL,
+                             *prdeLang = NULL;
+    PTR                       cbRoot = 0;
+
+    if (!rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size
+     || !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress)
+        return LOGICAL_FALSE;
+    cbRoot = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size;
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress, (PTR*)&prdRoot)))
+        return LOGICAL_FALSE;
+    if (PlResourceSubdirectory(prdRoot, cbRoot, 0) == NULL)
+        return LOGICAL_FALSE;
+    if ((prdeType = PlFindResourceEntry(prdRoot, dwType)) == NULL
+     || !(prdeType->OffsetToData & IMAGE_RESOURCE_DATA_IS_DIRECTORY)
+     || (prdName = PlResourceSubdirectory(prdRoot, cbRoot, prdeType->OffsetToData)) == NULL)
+        return LOGICAL_FALSE;
+    if ((prdeName = PlFindResourceEntry(prdName, wId)) == NULL
+     || !(prdeName->OffsetToData & IMAGE_RESOURCE_DATA_IS_DIRECTORY)
+     || (prdLang = PlResourceSubdirectory(prdRoot, cbRoot, prdeName->OffsetToData)) == NULL)
+        return LOGICAL_FALSE;
+    if (wLang == RESOURCE_ANY_LANGUAGE) {
+        if (!(prdLang->NumberOfNamedEntries + prdLang->NumberOfIdEntries))
+            return LOGICAL_FALSE;
+        prdeLang = (RESOURCE_DIRECTORY_ENTRY*)(prdLang + 1);
+    } else if ((prdeLang = PlFindResourceEntry(prdLang, wLang)) == NULL)
+        return LOGICAL_FALSE;
+    return PlFillResource(rpe, prdRoot, cbRoot, prdeType, prdeName, prdeLang, rl);
+}
+
+/// <summary>
+///	Header of a VS_VERSIONINFO style block (VS_VERSIONINFO, StringFileInfo, StringTable, String...) </summary>
+typedef struct _VERSION_BLOCK {
+    const WCHAR *szKey;
+    const void  *pValue;        // NULL if wValueLength is 0
+    WORD         wValueLength,  // in WCHARs if wType is 1, otherwise bytes
+                 wType;
+    const BYTE  *pChildren,     // first child block
+                *pEnd;          // end of this block
+} VERSION_BLOCK;
+
+/// <summary>
+///	Parses a version block header in place. Blocks and values are DWORD aligned relative
+/// to the start of the resource </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if the block is malformed or doesn't fit before pLimit </returns>
+static LOGICAL PlParseVersionBlock(IN const BYTE* pBase, IN const BYTE* pBlock, IN const BYTE* pLimit, OUT VERSION_BLOCK* vb) {
+    const WCHAR *pCurr = NULL;
+    WORD         wLength = 0;
+
+    if (pBlock + 3 * sizeof(WORD) > pLimit)
+        return LOGICAL_FALSE;
+    wLength = ((const WORD*)pBlock)[0];
+    vb->wValueLength = ((const WORD*)pBlock)[1];
+    vb->wType = ((const WORD*)pBlock)[2];
+    if (wLength < 3 * sizeof(WORD) || pBlock + wLength > pLimit)
+        return LOGICAL_FALSE;
+    vb->pEnd = pBlock + wLength;
+    vb->szKey = (const WCHAR*)(pBlock + 3 * sizeof(WORD));
+    for (pCurr = vb->szKey; (const BYTE*)pCurr + sizeof(WCHAR) <= vb->pEnd && *pCurr; ++pCurr)
+        ;
+    if ((const BYTE*)pCurr + sizeof(WCHAR) > vb->pEnd)
+        return LOGICAL_FALSE;
+    vb->pValue = pBase + PlAlignUp((PTR)((const BYTE*)(pCurr + 1) - pBase), sizeof(DWORD));
+    vb->pChildren = (const BYTE*)vb->pValue + PlAlignUp(vb->wType == 1 ? vb->wValueLength * sizeof(WCHAR) : vb->wValueLength, sizeof(DWORD));
+    if ((const BYTE*)vb->pValue > vb->pEnd)
+        return LOGICAL_FALSE;
+    if (vb->pChildren > vb->pEnd)   // some linkers count string values in bytes, value is checked by caller
+        vb->pChildren = vb->pEnd;
+    if (!vb->wValueLength)
+        vb->pValue = NULL;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Compares a block key against an ascii string </summary>
+///
+/// <returns>
+/// TRUE if equal </returns>
+static BOOL PlVersionKeyIs(IN const WCHAR* szKey, IN const char* szAscii) {
+    for (; *szAscii; ++szKey, ++szAscii)
+        if (*szKey != (WCHAR)(uint8_t)*szAscii)
+            return FALSE;
+    return *szKey == 0;
+}
+
+/// <summary>
+///	Gets next sibling of a version block </summary>
+///
+/// <returns>
+/// Pointer to next block (may be at or past pLimit) </returns>
+static const BYTE* PlNextVersionBlock(IN const BYTE* pBase, IN const VERSION_BLOCK* vb) {
+    return pBase + PlAlignUp((PTR)(vb->pEnd - pBase), sizeof(DWORD));
+}
+
+/// <summary>
+///	Gets VS_VERSIONINFO of an image straight from RT_VERSION. VS_FIXEDFILEINFO and the common
+/// StringFileInfo strings are returned as pointers into the image, nothing is allocated </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+/// <param name="vi">
+/// Pointer to VERSION_INFO that will recieve info, members not found are NULL </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there is no version resource or on PE error </returns>
+LOGICAL EXPORT LIBCALL PlGetVersionInfo(IN const RAW_PE* rpe, OUT VERSION_INFO* vi) {
+    RESOURCE_LIST   rl = {0};
+    VERSION_BLOCK   vbRoot = {0},
+                    vbChild = {0},
+                    vbTable = {0};
+    const BYTE     *pBase = NULL,
+                   *pLimit = NULL,
+                   *pCurr = NULL;
+    const WCHAR    *pHex = NULL;
+
+    memset(vi, 0, sizeof(*vi));
+    // VS_VERSION_INFO is always id 1 in practice, otherwise take whatever is under RT_VERSION
+    if (!LOGICAL_SUCCESS(PlFindResource(rpe, (PTR)RT_VERSION, 1, RESOURCE_ANY_LANGUAGE, &rl))) {
+        RESOURCE_ITERATOR ri = {0};
+        LOGICAL           lResult = PlFirstResource(rpe, &ri, &rl);
+
+        for (; LOGICAL_SUCCESS(lResult) && (rl.TypeName != NULL || rl.dwType != (PTR)RT_VERSION); lResult = PlNextResource(&ri, &rl))
+            ;
+        if (!LOGICAL_SUCCESS(lResult))
+            return LOGICAL_FALSE;
+    }
+    pBase = (const BYTE*)rl.pData;
+    pLimit = pBase + rl.cbSize;
+    if (!LOGICAL_SUCCESS(PlParseVersionBlock(pBase, pBase, pLimit, &vbRoot)) || !PlVersionKeyIs(vbRoot.szKey, "VS_VERSION_INFO"))
+        return LOGICAL_FALSE;
+    if (vbRoot.pValue != NULL && vbRoot.wValueLength >= sizeof(VS_FIXEDFILEINFO)
+     && (const BYTE*)vbRoot.pValue + sizeof(VS_FIXEDFILEINFO) <= vbRoot.pEnd
+     && ((const VS_FIXEDFILEINFO*)vbRoot.pValue)->dwSignature == 0xfeef04bd)
+        vi->pFixedInfo = (VS_FIXEDFILEINFO*)vbRoot.pValue;
+    // StringFileInfo -> first StringTable
+    for (pCurr = vbRoot.pChildren; LOGICAL_SUCCESS(PlParseVersionBlock(pBase, pCurr, vbRoot.pEnd, &vbChild)); pCurr = PlNextVersionBlock(pBase, &vbChild)) {
+        if (!PlVersionKeyIs(vbChild.szKey, "StringFileInfo"))
+            continue;
+        if (!LOGICAL_SUCCESS(PlParseVersionBlock(pBase, vbChild.pChildren, vbChild.pEnd, &vbTable)))
+            break;
+        vi->pStringTable = vbTable.pChildren;
+        vi->cbStringTable = vbTable.pEnd - vbTable.pChildren;
+        // key is "llllcccc" in hex
+        for (pHex = vbTable.szKey; *pHex && pHex < vbTable.szKey + 8; ++pHex) {
+            WORD wDigit = (*pHex >= '0' && *pHex <= '9') ? *pHex - '0' : ((*pHex | 0x20) >= 'a' && (*pHex | 0x20) <= 'f') ? (*pHex | 0x20) - 'a' + 10 : 0;
+            if (pHex < vbTable.szKey + 4)
+                vi->wLang = (vi->wLang << 4) | wDigit;
+            else
+                vi->wCodePage = (vi->wCodePage << 4) | wDigit;
+        }
+        break;
+    }
+    if (vi->pStringTable != NULL) {
+        PlQueryVersionString(vi, "CompanyName", &vi->CompanyName);
+        PlQueryVersionString(vi, "FileDescription", &vi->FileDescription);
+        PlQueryVersionString(vi, "FileVersion", &vi->FileVersion);
+        PlQueryVersionString(vi, "InternalName", &vi->InternalName);
+        PlQueryVersionString(vi, "LegalCopyright", &vi->LegalCopyright);
+        PlQueryVersionString(vi, "OriginalFilename", &vi->OriginalFilename);
+        PlQueryVersionString(vi, "ProductName", &vi->ProductName);
+        PlQueryVersionString(vi, "ProductVersion", &vi->ProductVersion);
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Looks up a string in the StringTable found by PlGetVersionInfo </summary>
+///
+/// <param name="vi">
+/// VERSION_INFO filled by PlGetVersionInfo </param>
+/// <param name="szKey">
+/// Ascii key, e.g. "CompanyName" </param>
+/// <param name="pszValue">
+/// Pointer that will recieve NUL terminated value in the image, NULL if not found </param>
+///
+/// <returns>
+/// LOGICAL_TRUE if found, LOGICAL_FALSE otherwise </returns>
+LOGICAL EXPORT LIBCALL PlQueryVersionString(IN const VERSION_INFO* vi, IN const char* szKey, OUT const WCHAR** pszValue) {
+    VERSION_BLOCK  vbString = {0};
+    const BYTE    *pCurr = (const BYTE*)vi->pStringTable,
+                  *pLimit = (const BYTE*)vi->pStringTable + vi->cbStringTable;
+    const WCHAR   *pChar = NULL;
+
+    *pszValue = NULL;
+    if (pCurr == NULL)
+        return LOGICAL_FALSE;
+    // the string table is DWORD aligned, so it works as a base for child alignment
+    for (; LOGICAL_SUCCESS(PlParseVersionBlock(pCurr, pCurr, pLimit, &vbString)); pCurr = PlNextVersionBlock(pCurr, &vbString)) {
+        if (!PlVersionKeyIs(vbString.szKey, szKey))
+            continue;
+        if (vbString.pValue == NULL)
+            return LOGICAL_FALSE;
+        // make sure it's terminated before handing it out
+        for (pChar = (const WCHAR*)vbString.pValue; (const BYTE*)pChar + sizeof(WCHAR) <= vbString.pEnd; ++pChar) {
+            if (!*pChar) {
+                *pszValue = (const WCHAR*)vbString.pValue;
+                return LOGICAL_TRUE;
+            }
+        }
+        return LOGICAL_FALSE;
+    }
+    return LOGICAL_FALSE;
+}
+
+/// <summary>
+///	Loads resource list into rpe->pResource </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlEnumerateResources(INOUT RAW_PE* rpe) {
+    RESOURCE_ITERATOR ri = {0};
+    RESOURCE_LIST     rl = {0},
+                     *pResource = NULL;
+
+    // do we even have resources?
+    if (!rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size
+     && !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress)
+        return LOGICAL_TRUE;
+    // a valid root without any (valid) resources is just an empty list
+    if (!LOGICAL_SUCCESS(PlFirstResource(rpe, &ri, &rl)))
+        return ri.prdeLevel[0] != NULL ? LOGICAL_TRUE : LOGICAL_FALSE;
+    do {
+        if (pResource == NULL) {
+            rpe->pResource = calloc(1, sizeof(*rpe->pResource));
+            pResource = rpe->pResource;
+        } else {
+            pResource->Flink = calloc(1, sizeof(RESOURCE_LIST));
+            pResource = (RESOURCE_LIST*)pResource->Flink;
+        }
+        if (pResource == NULL)
+            return LOGICAL_MAYBE;
+        *pResource = rl;
+        pResource->Flink = NULL;
+    } while (LOGICAL_SUCCESS(PlNextResource(&ri, &rl)));
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Frees resource list in rpe->pResource </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlFreeEnumeratedResources(INOUT RAW_PE* rpe) {
+    RESOURCE_LIST *pResource = NULL,
+                  *pResourceNext = NULL;
+
+    if (rpe->pResource == NULL)
+        return LOGICAL_FALSE;
+    for (pResource = rpe->pResource; pResource != NULL; pResource = pResourceNext) {
+        pResourceNext = (RESOURCE_LIST*)pResource->Flink;
+        free(pResource);
+    }
+    rpe->pResource = NULL;
+    return LOGICAL_TRUE;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "peel.h"
+
+#define RESOURCE_ANY_LANGUAGE ((PTR)-1)   // PlFindResource takes first language found
+
+#pragma region Resource functions
+    // iterating (no allocation, pointers are into the image)
+    LOGICAL EXPORT LIBCALL PlFirstResource(IN const RAW_PE* rpe, OUT RESOURCE_ITERATOR* ri, OUT RESOURCE_LIST* rl);
+    LOGICAL EXPORT LIBCALL PlNextResource(INOUT RESOURCE_ITERATOR* ri, OUT RESOURCE_LIST* rl);
+
+    // direct lookup
+    LOGICAL EXPORT LIBCALL PlFindResource(IN const RAW_PE* rpe, IN const PTR dwType, IN const PTR wId, IN const PTR wLang, OUT RESOURCE_LIST* rl);
+
+    // version info (no allocation, strings point into the image)
+    LOGICAL EXPORT LIBCALL PlGetVersionInfo(IN const RAW_PE* rpe, OUT VERSION_INFO* vi);
+    LOGICAL EXPORT LIBCALL PlQueryVersionString(IN const VERSION_INFO* vi, IN const char* szKey, OUT const WCHAR** pszValue);
+
+    // list in rpe->pResource
+    LOGICAL EXPORT LIBCALL PlEnumerateResources(INOUT RAW_PE* rpe);
+    LOGICAL EXPORT LIBCALL PlFreeEnumeratedResources(INOUT RAW_PE* rpe);
+#pragma endregion
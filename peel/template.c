@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "template.h"
+
+/// <summary>
+///	Gets a key that identifies a file: volume, file index and last write time for files opened with
+/// PlOpenFile, a hash of the contents otherwise </summary>
+///
+/// <param name="rpe">
+/// Pointer to RAW_PE containing file </param>
+/// <param name="pqwKey">
+/// Pointer to PTR64 that will recieve key </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error </returns>
+LOGICAL EXPORT LIBCALL PlGetFileIdentity(IN const RAW_PE* rpe, OUT PTR64* pqwKey) {
+    BY_HANDLE_FILE_INFORMATION bhfi;
+    PTR                        cbFile = rpe->cbBuffer;
+
+    if (rpe->hFile != NULL && GetFileInformationByHandle(rpe->hFile, &bhfi)) {
+        // access times change on every open, leave them out
+        memset(&bhfi.ftLastAccessTime, 0, sizeof(bhfi.ftLastAccessTime));
+        bhfi.nNumberOfLinks = 0;
+        *pqwKey = PlHashData(&bhfi, sizeof(bhfi));
+        return LOGICAL_TRUE;
+    }
+    if (!cbFile && !LOGICAL_SUCCESS(PlMaxPa(rpe, &cbFile)))
+        return LOGICAL_FALSE;
+    *pqwKey = PlHashData(rpe->pDosHdr, cbFile);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Collects every HIGHLOW and DIR64 relocation of the template's image into flat arrays so instances
+/// can be rebased without walking the relocation directory </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on crt/memory allocation error </returns>
+static LOGICAL PlCompileFixups(INOUT IMAGE_TEMPLATE* tpl) {
+    const RAW_PE    *rpe = &tpl->vm.PE;
+    BASE_RELOCATION *brReloc = NULL;
+    RELOC_ITEM      *riItem = NULL;
+    PTR              MaxRva = 0,
+                     RelocRva = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress,
+                     cbReloc = rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size,
+                     FixupRva = 0;
+    size_t           cItems = 0;
+
+    if (!RelocRva || !cbReloc)
+        return LOGICAL_TRUE;
+    if (!LOGICAL_SUCCESS(PlMaxRva(rpe, &MaxRva)) || RelocRva + cbReloc > MaxRva)
+        return LOGICAL_FALSE;
+    // first pass counts, second fills
+    for (register int iPass = 0; iPass < 2; ++iPass) {
+        if (iPass) {
+            if (tpl->cFixups32 && (tpl->pFixups32 = malloc(tpl->cFixups32 * sizeof(*tpl->pFixups32))) == NULL)
+                return LOGICAL_MAYBE;
+            if (tpl->cFixups64 && (tpl->pFixups64 = malloc(tpl->cFixups64 * sizeof(*tpl->pFixups64))) == NULL)
+                return LOGICAL_MAYBE;
+            tpl->cFixups32 = 0;
+            tpl->cFixups64 = 0;
+        }
+        for (brReloc = (BASE_RELOCATION*)((PTR)tpl->vm.pBaseAddr + RelocRva);
+             (PTR)brReloc + sizeof(BASE_RELOCATION) <= (PTR)tpl->vm.pBaseAddr + RelocRva + cbReloc && brReloc->SizeOfBlock >= sizeof(BASE_RELOCATION);
+             brReloc = (BASE_RELOCATION*)((PTR)brReloc + brReloc->SizeOfBlock)) {
+            riItem = (RELOC_ITEM*)((PTR)brReloc + sizeof(BASE_RELOCATION));
+            for (cItems = (brReloc->SizeOfBlock - sizeof(BASE_RELOCATION)) / sizeof(RELOC_ITEM); cItems; --cItems, ++riItem) {
+                FixupRva = brReloc->VirtualAddress + riItem->Offset;
+                switch (riItem->Type) {
+                    case IMAGE_REL_BASED_HIGHLOW:
+                        if (FixupRva + sizeof(PTR32) > MaxRva)
+                            return LOGICAL_FALSE;
+                        if (iPass)
+                            tpl->pFixups32[tpl->cFixups32] = (DWORD)FixupRva;
+                        ++tpl->cFixups32;
+                        break;
+                    case IMAGE_REL_BASED_DIR64:
+                        if (FixupRva + sizeof(PTR64) > MaxRva)
+                            return LOGICAL_FALSE;
+                        if (iPass)
+                            tpl->pFixups64[tpl->cFixups64] = (DWORD)FixupRva;
+                        ++tpl->cFixups64;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Releases a template that was never linked (or was just unlinked) </summary>
+static void PlFreeTemplate(INOUT IMAGE_TEMPLATE* tpl) {
+    if (tpl->vm.pBaseAddr != NULL)
+        PlFreeImage(&tpl->vm);
+    if (tpl->pFixups32 != NULL)
+        free(tpl->pFixups32);
+    if (tpl->pFixups64 != NULL)
+        free(tpl->pFixups64);
+    if (tpl->hBuilt != NULL)
+        CloseHandle(tpl->hBuilt);
+    free(tpl);
+}
+
+/// <summary>
+///	Loads the image of a template, moves it into a section (PlShareImage) and compiles its relocations </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+static LOGICAL PlBuildTemplate(INOUT IMAGE_TEMPLATE* tpl, IN const RAW_PE* rpe) {
+    LOGICAL lResult = PlFileToImage(rpe, &tpl->vm);
+
+    if (!LOGICAL_SUCCESS(lResult)) {
+        memset(&tpl->vm, 0, sizeof(tpl->vm));
+        return lResult;
+    }
+    lResult = PlShareImage(&tpl->vm);
+    if (LOGICAL_SUCCESS(lResult))
+        lResult = PlCompileFixups(tpl);
+    if (!LOGICAL_SUCCESS(lResult))
+        return lResult;
+    tpl->Base = tpl->vm.PE.pNtHdr->OptionalHeader.ImageBase;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Finds the template for a file in a context, building it the first time. The template is linked
+/// before it's built and the context lock is dropped while building, threads asking for the same file
+/// meanwhile wait for the build instead of the lock </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT that owns the templates </param>
+/// <param name="rpe">
+/// Pointer to RAW_PE containing file </param>
+/// <param name="pptpl">
+/// Pointer that will recieve template, valid until PlFreeTemplates </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlGetTemplate(INOUT PEEL_CONTEXT* ctx, IN const RAW_PE* rpe, OUT IMAGE_TEMPLATE** pptpl) {
+    IMAGE_TEMPLATE  *tpl = NULL,
+                   **pptplLink = NULL;
+    PTR64            qwKey = 0;
+    LOGICAL          lResult = LOGICAL_FALSE;
+    BOOL             bFree = FALSE;
+
+    *pptpl = NULL;
+    if (!LOGICAL_SUCCESS(PlGetFileIdentity(rpe, &qwKey)))
+        return LOGICAL_FALSE;
+    EnterCriticalSection(&ctx->csLock);
+    for (tpl = ctx->pTemplates; tpl != NULL; tpl = (IMAGE_TEMPLATE*)tpl->Flink) {
+        if (tpl->qwKey == qwKey
+         && tpl->TimeDateStamp == rpe->pNtHdr->FileHeader.TimeDateStamp
+         && tpl->SizeOfImage == rpe->pNtHdr->OptionalHeader.SizeOfImage) {
+            if (!tpl->bBuilding) {
+                LeaveCriticalSection(&ctx->csLock);
+                *pptpl = tpl;
+                return LOGICAL_TRUE;
+            }
+            // another thread is building it, a failed build is unlinked and freed by the last waiter
+            ++tpl->cWaiters;
+            LeaveCriticalSection(&ctx->csLock);
+            WaitForSingleObject(tpl->hBuilt, INFINITE);
+            EnterCriticalSection(&ctx->csLock);
+            lResult = tpl->lBuild;
+            bFree = !--tpl->cWaiters && !LOGICAL_SUCCESS(lResult);
+            LeaveCriticalSection(&ctx->csLock);
+            if (bFree)
+                PlFreeTemplate(tpl);
+            else if (LOGICAL_SUCCESS(lResult))
+                *pptpl = tpl;
+            return lResult;
+        }
+    }
+    tpl = calloc(1, sizeof(*tpl));
+    if (tpl == NULL) {
+        LeaveCriticalSection(&ctx->csLock);
+        return LOGICAL_MAYBE;
+    }
+    if ((tpl->hBuilt = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL) {
+        LeaveCriticalSection(&ctx->csLock);
+        free(tpl);
+        return LOGICAL_MAYBE;
+    }
+    tpl->qwKey = qwKey;
+    tpl->TimeDateStamp = rpe->pNtHdr->FileHeader.TimeDateStamp;
+    tpl->SizeOfImage = rpe->pNtHdr->OptionalHeader.SizeOfImage;
+    tpl->bBuilding = TRUE;
+    tpl->Flink = ctx->pTemplates;
+    ctx->pTemplates = tpl;
+    LeaveCriticalSection(&ctx->csLock);
+
+    lResult = PlBuildTemplate(tpl, rpe);
+
+    EnterCriticalSection(&ctx->csLock);
+    tpl->lBuild = lResult;
+    tpl->bBuilding = FALSE;
+    if (!LOGICAL_SUCCESS(lResult)) {
+        for (pptplLink = &ctx->pTemplates; *pptplLink != NULL; pptplLink = (IMAGE_TEMPLATE**)&(*pptplLink)->Flink) {
+            if (*pptplLink == tpl) {
+                *pptplLink = (IMAGE_TEMPLATE*)tpl->Flink;
+                break;
+            }
+        }
+    }
+    bFree = !LOGICAL_SUCCESS(lResult) && !tpl->cWaiters;
+    SetEvent(tpl->hBuilt);
+    LeaveCriticalSection(&ctx->csLock);
+    if (bFree)
+        PlFreeTemplate(tpl);
+    if (!LOGICAL_SUCCESS(lResult))
+        return lResult;
+    dmsg(TEXT("\nBuilt template of PE file at 0x%p (%u + %u fixups)"), rpe->pDosHdr, (unsigned int)tpl->cFixups32, (unsigned int)tpl->cFixups64);
+    *pptpl = tpl;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Creates an instance of a template as a copy-on-write view of its section, placed at the template's
+/// base if that's free. Otherwise only the compiled relocations are applied, so only pages holding
+/// them are ever copied </summary>
+///
+/// <param name="tpl">
+/// Template from PlGetTemplate </param>
+/// <param name="vm">
+/// Pointer to VIRTUAL_MODULE struct to recieve instance, release with PlFreeImage </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlInstantiateTemplate(IN const IMAGE_TEMPLATE* tpl, OUT VIRTUAL_MODULE* vm) {
+    LOGICAL lResult = LOGICAL_FALSE;
+    void   *pView = NULL;
+    PTR     Delta = 0;
+
+    pView = MapViewOfFileEx(tpl->vm.PE.hMapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0, (void*)tpl->Base);
+    if (pView == NULL)
+        pView = MapViewOfFile(tpl->vm.PE.hMapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0);
+    if (pView == NULL)
+        return LOGICAL_MAYBE;
+    lResult = PlAttachImage(pView, vm);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        if (vm->PE.ppSecHdr != NULL)
+            free(vm->PE.ppSecHdr);
+        if (vm->PE.ppSectionData != NULL)
+            free(vm->PE.ppSectionData);
+        UnmapViewOfFile(pView);
+        return lResult;
+    }
+    vm->PE.LoadStatus = tpl->vm.PE.LoadStatus;
+    vm->PE.LoadStatus.Attached = FALSE;
+    vm->PE.LoadStatus.Mapped = TRUE;
+    vm->PE.LoadStatus.Tracked = FALSE;
+    vm->PE.LoadStatus.Protected = FALSE;
+    vm->PE.pContext = tpl->vm.PE.pContext;
+    vm->PE.hFile = NULL;
+    vm->PE.hMapping = NULL;
+    Delta = (PTR)pView - tpl->Base;
+    if (Delta) {
+        for (register size_t i = 0; i < tpl->cFixups32; ++i)
+            *(PTR32*)((PTR)pView + tpl->pFixups32[i]) += (PTR32)Delta;
+        for (register size_t i = 0; i < tpl->cFixups64; ++i)
+            *(PTR64*)((PTR)pView + tpl->pFixups64[i]) += (PTR64)Delta;
+        vm->PE.pNtHdr->OptionalHeader.ImageBase = (PTR)pView;
+        vm->PE.LoadStatus.Relocated = TRUE;
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Releases every template of a context, instances stay valid. Must not run alongside PlGetTemplate </summary>
+///
+/// <param name="ctx">
+/// Pointer to PEEL_CONTEXT </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlFreeTemplates(INOUT PEEL_CONTEXT* ctx) {
+    IMAGE_TEMPLATE *tpl = NULL,
+                   *tplNext = NULL;
+
+    EnterCriticalSection(&ctx->csLock);
+    tpl = ctx->pTemplates;
+    ctx->pTemplates = NULL;
+    LeaveCriticalSection(&ctx->csLock);
+    for (; tpl != NULL; tpl = tplNext) {
+        tplNext = (IMAGE_TEMPLATE*)tpl->Flink;
+        PlFreeTemplate(tpl);
+    }
+    return LOGICAL_TRUE;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "tls.h"
+
+/// <summary>
+///	Gets a pointer to cb bytes at Rva, all of them have to be in the same section </summary>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if the range isn't in one piece of rpe </returns>
+static LOGICAL PlGetRvaRangePtr(IN const RAW_PE* rpe, IN PTR Rva, IN size_t cb, OUT PTR* Ptr) {
+    PTR pLast = 0;
+
+    if (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva, Ptr)))
+        return LOGICAL_FALSE;
+    if (cb && (!LOGICAL_SUCCESS(PlGetRvaPtr(rpe, Rva + cb - 1, &pLast)) || pLast - *Ptr != cb - 1))
+        return LOGICAL_FALSE;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Resolves the TLS directory into pointers, the directory holds VAs so rpe's ImageBase has to be
+/// the base its contents are relocated for (it is after PlFileToImageAt/PlRelocate) </summary>
+///
+/// <param name="rpe">
+/// Loaded RAW_PE, file or image (&vm->PE) </param>
+/// <param name="pti">
+/// Receives pointers into rpe </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if there is no TLS directory, it points outside of the PE
+/// or the template or callback array run past their section </returns>
+LOGICAL EXPORT LIBCALL PlGetTlsInfo(IN const RAW_PE* rpe, OUT TLS_INFO* pti) {
+    TLS_DIRECTORY *ptdDir = NULL;
+    PTR            Base = rpe->pNtHdr->OptionalHeader.ImageBase,
+                   Slot = 0;
+    DWORD          dwAlign = 0;
+
+    memset(pti, 0, sizeof(*pti));
+    if (!rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress
+     || !rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].Size)
+        return LOGICAL_FALSE;
+    if (!LOGICAL_SUCCESS(PlGetRvaRangePtr(rpe, rpe->pNtHdr->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress, sizeof(*ptdDir), (PTR*)&ptdDir)))
+        return LOGICAL_FALSE;
+    if (ptdDir->EndAddressOfRawData < ptdDir->StartAddressOfRawData)
+        return LOGICAL_FALSE;
+    pti->ptdDir = ptdDir;
+    pti->cbTemplate = (size_t)(ptdDir->EndAddressOfRawData - ptdDir->StartAddressOfRawData);
+    // the whole template is copied into every block
+    if (pti->cbTemplate && !LOGICAL_SUCCESS(PlGetRvaRangePtr(rpe, (PTR)ptdDir->StartAddressOfRawData - Base, pti->cbTemplate, (PTR*)&pti->pTemplate))) {
+        pti->pTemplate = NULL;
+        return LOGICAL_FALSE;
+    }
+    pti->cbZeroFill = ptdDir->SizeOfZeroFill;
+    // same encoding as section alignment, IMAGE_SCN_ALIGN_1BYTES is 1
+    dwAlign = (ptdDir->Characteristics >> 20) & 0x0f;
+    pti->dwAlignment = dwAlign ? 1 << (dwAlign - 1) : 0;
+    if (pti->dwAlignment < 0x10)
+        pti->dwAlignment = 0x10;
+    if (ptdDir->AddressOfIndex && !LOGICAL_SUCCESS(PlGetRvaRangePtr(rpe, (PTR)ptdDir->AddressOfIndex - Base, sizeof(*pti->pdwIndex), (PTR*)&pti->pdwIndex)))
+        return LOGICAL_FALSE;
+    if (ptdDir->AddressOfCallBacks) {
+        if (!LOGICAL_SUCCESS(PlGetRvaRangePtr(rpe, (PTR)ptdDir->AddressOfCallBacks - Base, sizeof(*pti->pCallbacks), (PTR*)&pti->pCallbacks)))
+            return LOGICAL_FALSE;
+        // every slot up to the terminating 0 has to be in the same section as the first
+        for (;;) {
+            if (!LOGICAL_SUCCESS(PlGetRvaRangePtr(rpe, (PTR)ptdDir->AddressOfCallBacks - Base + pti->cCallbacks * sizeof(*pti->pCallbacks), sizeof(*pti->pCallbacks), &Slot))
+             || Slot != (PTR)&pti->pCallbacks[pti->cCallbacks]) {
+                pti->pCallbacks = NULL;
+                pti->cCallbacks = 0;
+                return LOGICAL_FALSE;
+            }
+            if (!pti->pCallbacks[pti->cCallbacks])
+                break;
+            ++pti->cCallbacks;
+        }
+    }
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Prepares a pool handing out TLS blocks of one image </summary>
+///
+/// <param name="pti">
+/// TLS_INFO from PlGetTlsInfo, copied (pointers into the image have to stay valid) </param>
+/// <param name="ptp">
+/// Pointer to TLS_POOL to initialize </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlCreateTlsPool(IN const TLS_INFO* pti, OUT TLS_POOL* ptp) {
+    size_t cbData = pti->cbTemplate + pti->cbZeroFill;
+
+    memset(ptp, 0, sizeof(*ptp));
+    InitializeCriticalSection(&ptp->csLock);
+    ptp->Info = *pti;
+    // free blocks hold the free list link
+    ptp->cbBlock = PlAlignUp(cbData > sizeof(void*) ? cbData : sizeof(void*), pti->dwAlignment);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Hands out a TLS block initialized like the loader does, template followed by zero fill </summary>
+///
+/// <param name="ptp">
+/// Pointer to TLS_POOL </param>
+/// <param name="ppBlock">
+/// Receives block, aligned to Info.dwAlignment </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_MAYBE on crt/memory allocation error </returns>
+LOGICAL EXPORT LIBCALL PlAllocTlsBlock(INOUT TLS_POOL* ptp, OUT void** ppBlock) {
+    void *pBlock = NULL,
+         *pSlab = NULL;
+
+    *ppBlock = NULL;
+    EnterCriticalSection(&ptp->csLock);
+    if (ptp->pFree != NULL) {
+        pBlock = ptp->pFree;
+        ptp->pFree = *(void**)pBlock;
+    } else {
+        if (!ptp->cCarve) {
+            // slab link goes in front of the first block
+            pSlab = malloc(sizeof(void*) + ptp->Info.dwAlignment + TLS_BLOCKS_PER_SLAB * ptp->cbBlock);
+            if (pSlab == NULL) {
+                LeaveCriticalSection(&ptp->csLock);
+                return LOGICAL_MAYBE;
+            }
+            *(void**)pSlab = ptp->pSlabs;
+            ptp->pSlabs = pSlab;
+            ptp->pCarve = (BYTE*)(((PTR)pSlab + sizeof(void*) + ptp->Info.dwAlignment - 1) & ~(PTR)(ptp->Info.dwAlignment - 1));
+            ptp->cCarve = TLS_BLOCKS_PER_SLAB;
+        }
+        pBlock = ptp->pCarve;
+        ptp->pCarve += ptp->cbBlock;
+        --ptp->cCarve;
+    }
+    LeaveCriticalSection(&ptp->csLock);
+    if (ptp->Info.cbTemplate)
+        memcpy(pBlock, ptp->Info.pTemplate, ptp->Info.cbTemplate);
+    memset((BYTE*)pBlock + ptp->Info.cbTemplate, 0, ptp->cbBlock - ptp->Info.cbTemplate);
+    *ppBlock = pBlock;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Returns a TLS block to its pool </summary>
+///
+/// <param name="ptp">
+/// Pointer to TLS_POOL the block came from </param>
+/// <param name="pBlock">
+/// Block from PlAllocTlsBlock </param>
+///
+/// <returns>
+/// LOGICAL_TRUE </returns>
+LOGICAL EXPORT LIBCALL PlFreeTlsBlock(INOUT TLS_POOL* ptp, IN void* pBlock) {
+    EnterCriticalSection(&ptp->csLock);
+    *(void**)pBlock = ptp->pFree;
+    ptp->pFree = pBlock;
+    LeaveCriticalSection(&ptp->csLock);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Releases every block of a pool, handed out or not </summary>
+///
+/// <param name="ptp">
+/// Pointer to TLS_POOL </param>
+///
+/// <returns>
+/// LOGICAL_TRUE, *ptp is zeroed </returns>
+LOGICAL EXPORT LIBCALL PlDestroyTlsPool(INOUT TLS_POOL* ptp) {
+    void *pSlab = NULL,
+         *pNext = NULL;
+
+    for (pSlab = ptp->pSlabs; pSlab != NULL; pSlab = pNext) {
+        pNext = *(void**)pSlab;
+        free(pSlab);
+    }
+    DeleteCriticalSection(&ptp->csLock);
+    memset(ptp, 0, sizeof(*ptp));
+    return LOGICAL_TRUE;
+}
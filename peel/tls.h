@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2013 x8esix
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "peel.h"
+
+#pragma region TLS functions
+    LOGICAL EXPORT LIBCALL PlGetTlsInfo(IN const RAW_PE* rpe, OUT TLS_INFO* pti);
+
+    // per-thread blocks, initialized from the template
+    LOGICAL EXPORT LIBCALL PlCreateTlsPool(IN const TLS_INFO* pti, OUT TLS_POOL* ptp);
+    LOGICAL EXPORT LIBCALL PlAllocTlsBlock(INOUT TLS_POOL* ptp, OUT void** ppBlock);
+    LOGICAL EXPORT LIBCALL PlFreeTlsBlock(INOUT TLS_POOL* ptp, IN void* pBlock);
+    LOGICAL EXPORT LIBCALL PlDestroyTlsPool(INOUT TLS_POOL* ptp);
+#pragma endregion
@@ -69,14 +69,32 @@
         typedef THUNK_DATA32             THUNK_DATA;
 #endif
         typedef IMAGE_IMPORT_BY_NAME	 IMPORT_NAME;
+        typedef IMAGE_TLS_DIRECTORY32    TLS_DIRECTORY32;
+        typedef IMAGE_TLS_DIRECTORY64    TLS_DIRECTORY64;
+#if SUPPORT_PE32PLUS
+        typedef TLS_DIRECTORY64          TLS_DIRECTORY;
+#else
+        typedef TLS_DIRECTORY32          TLS_DIRECTORY;
+#endif
+        typedef IMAGE_BOUND_IMPORT_DESCRIPTOR BOUND_IMPORT_DESCRIPTOR;
+        typedef IMAGE_BOUND_FORWARDER_REF BOUND_FORWARDER_REF;
         typedef IMAGE_EXPORT_DIRECTORY   EXPORT_DIRECTORY;
         typedef IMAGE_DEBUG_DIRECTORY    DEBUG_DIRECTORY;
         typedef IMAGE_RESOURCE_DIRECTORY RESOURCE_DIRECTORY;
         typedef IMAGE_RESOURCE_DIRECTORY_ENTRY RESOURCE_DIRECTORY_ENTRY;
         typedef IMAGE_RESOURCE_DATA_ENTRY RESOURCE_DATA_ENTRY;
+        typedef IMAGE_RESOURCE_DIR_STRING_U RESOURCE_DIR_STRING;
         
         #define OPT_HDR_MAGIC32 IMAGE_NT_OPTIONAL_HDR32_MAGIC
         #define OPT_HDR_MAGIC64 IMAGE_NT_OPTIONAL_HDR64_MAGIC
+        #define DELAY_ATTRIBUTE_RVA 0x01     // dlattrRva, delay import descriptor holds rvas
+        #define GUARD_CF_INSTRUMENTED 0x100          // IMAGE_GUARD_CF_INSTRUMENTED, GuardFlags
+        #define GUARD_CF_STRIDE_MASK 0xF0000000      // IMAGE_GUARD_CF_FUNCTION_TABLE_SIZE_MASK, extra bytes per GuardCFFunctionTable entry
+        #define GUARD_CF_STRIDE_SHIFT 28
+        #define GUARD_FLAG_FID_SUPPRESSED 0x01       // first extra byte of a GuardCFFunctionTable entry
+        #define GUARD_FLAG_EXPORT_SUPPRESSED 0x02
+        #define CODEVIEW_SIGNATURE_RSDS 0x53445352   // 'RSDS', pdb 7.0 CodeView record
+        #define CODEVIEW_SIGNATURE_NB10 0x3031424e   // 'NB10', pdb 2.0 CodeView record
 #if SUPPORT_PE32PLUS
         #define OPT_HDR_MAGIC OPT_HDR_MAGIC64
 #else
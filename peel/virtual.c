@@ -34,6 +34,7 @@
 /// <returns>
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT error </returns>
 LOGICAL EXPORT LIBCALL PlAttachImage(IN const void* const pModuleBase, OUT VIRTUAL_MODULE* vm) {
+    PTR MaxRva = 0;
     
     // leave other members alone (name needs to be set externally)
     memset(&vm->PE, 0, sizeof(vm->PE));
@@ -75,6 +76,9 @@ LOGICAL EXPORT LIBCALL PlAttachImage(IN const void* const pModuleBase, OUT VIRTU
     }
     memset(&vm->PE.LoadStatus, 0, sizeof(vm->PE.LoadStatus));
     vm->PE.LoadStatus.Attached = TRUE;
+    vm->PE.LoadStatus.Image = TRUE;
+    PlMaxRva(&vm->PE, &MaxRva);
+    vm->PE.cbBuffer = MaxRva;
     dmsg(TEXT("\nAttached to PE image at 0x%p"), vm->pBaseAddr);
     return LOGICAL_TRUE;
 }
@@ -90,10 +94,13 @@ LOGICAL EXPORT LIBCALL PlAttachImage(IN const void* const pModuleBase, OUT VIRTU
 LOGICAL EXPORT LIBCALL PlDetachImage(INOUT VIRTUAL_MODULE* vm) {
     VIRTUAL_MODULE *vmNext = NULL,
                    *vmPrev = NULL;
+    PEEL_CONTEXT   *ctx = vm->PE.pContext;
 
     if (!LOGICAL_SUCCESS(PlDetachFile(&vm->PE)))
         return LOGICAL_FALSE;
     dmsg(TEXT("\nUnlinking PE Image at %p"), vm->pBaseAddr);
+    if (ctx != NULL)
+        PlUnregisterImage(ctx, vm);
     vmPrev = (VIRTUAL_MODULE*)vm->Blink;
     vmNext = (VIRTUAL_MODULE*)vm->Flink;
     if (vmPrev != NULL)
@@ -118,13 +125,19 @@ LOGICAL EXPORT LIBCALL PlDetachImage(INOUT VIRTUAL_MODULE* vm) {
 LOGICAL EXPORT LIBCALL PlImageToFile(IN const VIRTUAL_MODULE* vm, OUT RAW_PE* rpe) {
     PTR MaxPa = 0;
     void* pImage = NULL;
+    LOGICAL lResult = LOGICAL_FALSE;
 
     if (!LOGICAL_SUCCESS(PlMaxPa(&vm->PE, &MaxPa)))
         return LOGICAL_FALSE;
-    pImage = VirtualAlloc(NULL, MaxPa, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    if (pImage == NULL)
+    if (!LOGICAL_SUCCESS(PlPoolAlloc(vm->PE.pContext, MaxPa, &pImage)))
         return LOGICAL_MAYBE;
-    return PlImageToFileEx(vm, pImage, rpe);
+    lResult = PlImageToFileEx(vm, pImage, rpe);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        PlPoolFree(vm->PE.pContext, pImage, MaxPa);
+        return lResult;
+    }
+    rpe->LoadStatus.Pooled = vm->PE.pContext != NULL;
+    return LOGICAL_TRUE;
 }
 
 /// <summary>
@@ -141,11 +154,11 @@ LOGICAL EXPORT LIBCALL PlImageToFile(IN const VIRTUAL_MODULE* vm, OUT RAW_PE* rp
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
 LOGICAL EXPORT LIBCALL PlImageToFileEx(IN const VIRTUAL_MODULE* vm, IN const void* pBuffer, OUT RAW_PE* rpe) {
     PTR MaxPa = 0;
+    COPY_RANGE crWritten[MAX_SECTIONS + 2];     // headers, section table, sections
+    size_t     cWritten = 0;
     
-    // unnecessary per standard, but let's play nice with gaps
     if (!LOGICAL_SUCCESS(PlMaxPa(&vm->PE, &MaxPa)))
         return LOGICAL_FALSE;
-    memset((void*)pBuffer, 0, MaxPa);
     
     rpe->pDosHdr = (DOS_HEADER*)pBuffer;
     memmove(rpe->pDosHdr, vm->PE.pDosHdr, sizeof(DOS_HEADER));
@@ -153,6 +166,8 @@ LOGICAL EXPORT LIBCALL PlImageToFileEx(IN const VIRTUAL_MODULE* vm, IN const voi
     memmove(rpe->pDosStub, vm->PE.pDosStub, rpe->pDosHdr->e_lfanew - sizeof(DOS_HEADER));
     rpe->pNtHdr = (NT_HEADERS*)((PTR)rpe->pDosHdr + rpe->pDosHdr->e_lfanew);
     memmove(rpe->pNtHdr, vm->PE.pNtHdr, sizeof(NT_HEADERS));
+    crWritten[cWritten].Offset = 0;
+    crWritten[cWritten++].cbSize = rpe->pDosHdr->e_lfanew + sizeof(NT_HEADERS);
     if (rpe->pNtHdr->FileHeader.NumberOfSections) {
         WORD wNumSections = vm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : vm->PE.pNtHdr->FileHeader.NumberOfSections;
         if (vm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS) 
@@ -164,19 +179,34 @@ LOGICAL EXPORT LIBCALL PlImageToFileEx(IN const VIRTUAL_MODULE* vm, IN const voi
         rpe->ppSectionData = malloc(wNumSections * sizeof(*rpe->ppSectionData));
         if (rpe->ppSectionData == NULL)
             return LOGICAL_MAYBE;
+        crWritten[cWritten].Offset = (PTR)&rpe->pNtHdr->OptionalHeader + rpe->pNtHdr->FileHeader.SizeOfOptionalHeader - (PTR)pBuffer;
+        crWritten[cWritten++].cbSize = wNumSections * sizeof(SECTION_HEADER);
         for (register size_t i = 0; i < wNumSections; ++i) {
             rpe->ppSecHdr[i] = (SECTION_HEADER*)((PTR)&rpe->pNtHdr->OptionalHeader + rpe->pNtHdr->FileHeader.SizeOfOptionalHeader + sizeof(SECTION_HEADER) * i);
             memmove(rpe->ppSecHdr[i], vm->PE.ppSecHdr[i], sizeof(SECTION_HEADER));
             rpe->ppSectionData[i] = (void*)((PTR)rpe->pDosHdr + rpe->ppSecHdr[i]->PointerToRawData);
-            memmove(rpe->ppSectionData[i], vm->PE.ppSectionData[i], rpe->ppSecHdr[i]->SizeOfRawData);
+            PlCopyMemory(rpe->ppSectionData[i], vm->PE.ppSectionData[i], rpe->ppSecHdr[i]->SizeOfRawData);
+            crWritten[cWritten].Offset = (PTR)rpe->ppSectionData[i] - (PTR)pBuffer;
+            crWritten[cWritten++].cbSize = rpe->ppSecHdr[i]->SizeOfRawData;
         }
     } else {
         rpe->ppSecHdr = NULL;
         rpe->ppSectionData = NULL;
     }
+    // unnecessary per standard, but let's play nice with gaps (only the gaps, the rest was just written)
+    PlZeroGaps((void*)pBuffer, MaxPa, crWritten, cWritten);
     memset(&rpe->LoadStatus, 0, sizeof(rpe->LoadStatus));
     rpe->LoadStatus = vm->PE.LoadStatus;
     rpe->LoadStatus.Attached = FALSE;
+    rpe->LoadStatus.Mapped = FALSE;
+    rpe->LoadStatus.Tracked = FALSE;
+    rpe->pDirty = NULL;
+    rpe->LoadStatus.Pooled = FALSE;
+    rpe->LoadStatus.Image = FALSE;
+    rpe->pContext = vm->PE.pContext;
+    rpe->hFile = NULL;
+    rpe->hMapping = NULL;
+    rpe->cbBuffer = MaxPa;
     return LOGICAL_TRUE;
 }
 
@@ -194,13 +224,19 @@ LOGICAL EXPORT LIBCALL PlImageToFileEx(IN const VIRTUAL_MODULE* vm, IN const voi
 LOGICAL EXPORT LIBCALL PlCopyImage(IN VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cvm) {
     PTR MaxPa = 0;
     void* pCopy = NULL;
+    LOGICAL lResult = LOGICAL_FALSE;
 
     if (!LOGICAL_SUCCESS(PlMaxRva(&vm->PE, &MaxPa)))
         return LOGICAL_FALSE;
-    pCopy = VirtualAlloc(NULL, MaxPa, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    if (pCopy == NULL)
+    if (!LOGICAL_SUCCESS(PlPoolAlloc(vm->PE.pContext, MaxPa, &pCopy)))
         return LOGICAL_MAYBE;
-    return PlCopyImageEx(vm, (void*)pCopy, cvm);
+    lResult = PlCopyImageEx(vm, (void*)pCopy, cvm);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        PlPoolFree(vm->PE.pContext, pCopy, MaxPa);
+        return lResult;
+    }
+    cvm->PE.LoadStatus.Pooled = vm->PE.pContext != NULL;
+    return LOGICAL_TRUE;
 }
 
 /// <summary>
@@ -218,11 +254,11 @@ LOGICAL EXPORT LIBCALL PlCopyImage(IN VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cv
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
 LOGICAL EXPORT LIBCALL PlCopyImageEx(IN VIRTUAL_MODULE* vm, IN const void* pBuffer, OUT VIRTUAL_MODULE* cvm) {
     PTR MaxPa = 0;
+    COPY_RANGE crWritten[MAX_SECTIONS + 2];     // headers, section table, sections
+    size_t     cWritten = 0;
 
-    // unnecessary per standard, but let's play nice with gaps
     if (!LOGICAL_SUCCESS(PlMaxRva(&vm->PE, &MaxPa)))
         return LOGICAL_FALSE;
-    memset((void*)pBuffer, 0, MaxPa);
 
     cvm->pBaseAddr = (void*)pBuffer;
     cvm->PE.pDosHdr = (DOS_HEADER*)cvm->pBaseAddr;
@@ -231,6 +267,8 @@ LOGICAL EXPORT LIBCALL PlCopyImageEx(IN VIRTUAL_MODULE* vm, IN const void* pBuff
     memmove(cvm->PE.pDosStub, vm->PE.pDosStub, (PTR)cvm->PE.pDosHdr->e_lfanew - sizeof(DOS_HEADER));
     cvm->PE.pNtHdr = (NT_HEADERS*)((PTR)cvm->pBaseAddr + cvm->PE.pDosHdr->e_lfanew);
     memmove(cvm->PE.pNtHdr, vm->PE.pNtHdr, sizeof(NT_HEADERS));
+    crWritten[cWritten].Offset = 0;
+    crWritten[cWritten++].cbSize = cvm->PE.pDosHdr->e_lfanew + sizeof(NT_HEADERS);
     if (cvm->PE.pNtHdr->FileHeader.NumberOfSections) {
         WORD wNumSections = cvm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : cvm->PE.pNtHdr->FileHeader.NumberOfSections;
         if (cvm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS) 
@@ -242,28 +280,319 @@ LOGICAL EXPORT LIBCALL PlCopyImageEx(IN VIRTUAL_MODULE* vm, IN const void* pBuff
         cvm->PE.ppSectionData = malloc(wNumSections * sizeof(*cvm->PE.ppSectionData));
         if (cvm->PE.ppSectionData == NULL)
             return LOGICAL_MAYBE;
+        crWritten[cWritten].Offset = (PTR)&cvm->PE.pNtHdr->OptionalHeader + cvm->PE.pNtHdr->FileHeader.SizeOfOptionalHeader - (PTR)pBuffer;
+        crWritten[cWritten++].cbSize = wNumSections * sizeof(SECTION_HEADER);
         for (register size_t i = 0; i < wNumSections; ++i) {
             cvm->PE.ppSecHdr[i] = (SECTION_HEADER*)((PTR)&cvm->PE.pNtHdr->OptionalHeader + cvm->PE.pNtHdr->FileHeader.SizeOfOptionalHeader + sizeof(SECTION_HEADER) * i);
             memmove(cvm->PE.ppSecHdr[i], vm->PE.ppSecHdr[i], sizeof(SECTION_HEADER));
             cvm->PE.ppSectionData[i] = (void*)((PTR)cvm->pBaseAddr + cvm->PE.ppSecHdr[i]->VirtualAddress);
-            memmove(cvm->PE.ppSectionData[i], vm->PE.ppSectionData[i], cvm->PE.ppSecHdr[i]->Misc.VirtualSize);
+            PlCopyMemory(cvm->PE.ppSectionData[i], vm->PE.ppSectionData[i], cvm->PE.ppSecHdr[i]->Misc.VirtualSize);
+            crWritten[cWritten].Offset = (PTR)cvm->PE.ppSectionData[i] - (PTR)pBuffer;
+            crWritten[cWritten++].cbSize = cvm->PE.ppSecHdr[i]->Misc.VirtualSize;
         }
     } else {
         cvm->PE.ppSecHdr = NULL;
         cvm->PE.ppSectionData = NULL;
     }
+    // unnecessary per standard, but let's play nice with gaps (only the gaps, the rest was just written)
+    PlZeroGaps((void*)pBuffer, MaxPa, crWritten, cWritten);
     memset(&cvm->PE.LoadStatus, 0, sizeof(cvm->PE.LoadStatus));
     cvm->PE.LoadStatus = vm->PE.LoadStatus;
     cvm->PE.LoadStatus.Attached = FALSE;
+    cvm->PE.LoadStatus.Mapped = FALSE;
+    cvm->PE.LoadStatus.Tracked = FALSE;
+    cvm->PE.pDirty = NULL;
+    cvm->PE.LoadStatus.Pooled = FALSE;
+    cvm->PE.pContext = vm->PE.pContext;
+    cvm->PE.hFile = NULL;
+    cvm->PE.hMapping = NULL;
+    cvm->PE.cbBuffer = MaxPa;
+    cvm->Blink = (void*)vm;
+    cvm->Flink = vm->Flink;
+    if (vm->Flink != NULL)
+        ((VIRTUAL_MODULE*)vm->Flink)->Blink = (void*)cvm;
+    vm->Flink = (void*)cvm;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Points vm at a new base after its view moved, lists that point into the old view are freed </summary>
+static void PlRebaseImagePointers(INOUT VIRTUAL_MODULE* vm, IN void* pNewBase) {
+    PTR  Delta = (PTR)pNewBase - (PTR)vm->pBaseAddr;
+    WORD wNumSections = vm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : vm->PE.pNtHdr->FileHeader.NumberOfSections;
+
+    vm->pBaseAddr = pNewBase;
+    vm->PE.pDosHdr = (DOS_HEADER*)((PTR)vm->PE.pDosHdr + Delta);
+    vm->PE.pDosStub = (DOS_STUB*)((PTR)vm->PE.pDosStub + Delta);
+    vm->PE.pNtHdr = (NT_HEADERS*)((PTR)vm->PE.pNtHdr + Delta);
+    for (register size_t i = 0; vm->PE.ppSecHdr != NULL && i < wNumSections; ++i) {
+        vm->PE.ppSecHdr[i] = (SECTION_HEADER*)((PTR)vm->PE.ppSecHdr[i] + Delta);
+        vm->PE.ppSectionData[i] = (void*)((PTR)vm->PE.ppSectionData[i] + Delta);
+    }
+    if (vm->PE.pCaveData != NULL)
+        PlFreeEnumeratedCodecaves(&vm->PE);
+    if (vm->PE.pImport != NULL)
+        PlFreeEnumeratedImports(&vm->PE);
+    if (vm->PE.pExport != NULL)
+        PlFreeEnumeratedExports(&vm->PE);
+    if (vm->PE.pResource != NULL)
+        PlFreeEnumeratedResources(&vm->PE);
+}
+
+/// <summary>
+///	Moves an allocated image into a pagefile backed section so PlCopyImageCow can clone it. The
+/// image keeps its address if it can and is itself a copy-on-write view afterwards, so the section
+/// stays a snapshot of the image as it was when shared. A protected image is unprotected while it's
+/// copied and protected again afterwards, the section itself holds read/write pages </summary>
+///
+/// <param name="vm">
+/// Loaded VIRTUAL_MODULE struct that is not attached </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error (image is lost if
+/// it couldn't be mapped back, *vm is zeroed) </returns>
+LOGICAL EXPORT LIBCALL PlShareImage(INOUT VIRTUAL_MODULE* vm) {
+    PTR     MaxRva = 0;
+    HANDLE  hSection = NULL;
+    void   *pView = NULL,
+           *pOld = vm->pBaseAddr;
+    BOOL    bProtected = vm->PE.LoadStatus.Protected;
+
+    if (vm->PE.LoadStatus.Attached)
+        return LOGICAL_FALSE;
+    // already backed by a section (shared or mapped by PlFileToImageMapped)
+    if (vm->PE.LoadStatus.Mapped && vm->PE.hMapping != NULL)
+        return LOGICAL_TRUE;
+    if (!LOGICAL_SUCCESS(PlMaxRva(&vm->PE, &MaxRva)))
+        return LOGICAL_FALSE;
+    // no access and execute only pages can't be copied
+    if (bProtected && !LOGICAL_SUCCESS(PlUnprotectImage(vm)))
+        return LOGICAL_FALSE;
+    // views can only be made executable (PlProtectImage) if the section and the view allow it
+    hSection = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_EXECUTE_READWRITE, (DWORD)((uint64_t)MaxRva >> 32), (DWORD)MaxRva, NULL);
+    if (hSection == NULL) {
+        if (bProtected)
+            PlProtectImage(vm);
+        return LOGICAL_MAYBE;
+    }
+    pView = MapViewOfFile(hSection, FILE_MAP_WRITE, 0, 0, MaxRva);
+    if (pView == NULL) {
+        CloseHandle(hSection);
+        if (bProtected)
+            PlProtectImage(vm);
+        return LOGICAL_MAYBE;
+    }
+    memmove(pView, pOld, MaxRva);
+    UnmapViewOfFile(pView);
+
+    // allocation base is on allocation granularity, so the view can usually take its place. Pooling the old
+    // buffer would keep its range reserved, so it is released even if it came from the pool
+    if (vm->PE.LoadStatus.Mapped)
+        UnmapViewOfFile(pOld);
+    else
+        VirtualFree(pOld, 0, MEM_RELEASE);
+    vm->PE.LoadStatus.Pooled = FALSE;
+    pView = MapViewOfFileEx(hSection, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, MaxRva, pOld);
+    if (pView == NULL) {
+        pView = MapViewOfFile(hSection, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, MaxRva);
+        if (pView == NULL) {
+            dmsg(TEXT("\nLost PE image at 0x%p while sharing it!"), pOld);
+            CloseHandle(hSection);
+            if (vm->PE.ppSecHdr != NULL)
+                free(vm->PE.ppSecHdr);
+            if (vm->PE.ppSectionData != NULL)
+                free(vm->PE.ppSectionData);
+            memset(&vm->PE, 0, sizeof(vm->PE));
+            vm->pBaseAddr = NULL;
+            return LOGICAL_MAYBE;
+        }
+        dmsg(TEXT("\nPE image moved from 0x%p to 0x%p while sharing"), pOld, pView);
+        PlRebaseImagePointers(vm, pView);
+    }
+    vm->PE.LoadStatus.Mapped = TRUE;
+    vm->PE.LoadStatus.Protected = FALSE;
+    vm->PE.hMapping = hSection;
+    vm->PE.cbBuffer = MaxRva;
+    if (bProtected && !LOGICAL_SUCCESS(PlProtectImage(vm)))
+        return LOGICAL_MAYBE;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Clones an image as a copy-on-write view of its section, pages are only copied once they are written.
+/// vm is shared with PlShareImage first if it needs to be. The clone never sits at vm's base, so it comes back
+/// unrelocated, and if vm was shared (or mapped) before it is the section as it was back then and unimported too </summary>
+///
+/// <param name="vm">
+/// Loaded VIRTUAL_MODULE struct that is not attached </param>
+/// <param name="cvm">
+/// Pointer to VIRTUAL_MODULE struct to recieve clone, linked after vm </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlCopyImageCow(INOUT VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cvm) {
+    LOGICAL lResult = LOGICAL_FALSE;
+    void   *pView = NULL;
+    BOOL    bStale = vm->PE.LoadStatus.Mapped && vm->PE.hMapping != NULL;
+
+    lResult = PlShareImage(vm);
+    if (!LOGICAL_SUCCESS(lResult))
+        return lResult;
+    pView = MapViewOfFile(vm->PE.hMapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0);
+    if (pView == NULL)
+        return LOGICAL_MAYBE;
+    lResult = PlAttachImage(pView, cvm);
+    if (!LOGICAL_SUCCESS(lResult)) {
+        if (cvm->PE.ppSecHdr != NULL)
+            free(cvm->PE.ppSecHdr);
+        if (cvm->PE.ppSectionData != NULL)
+            free(cvm->PE.ppSectionData);
+        UnmapViewOfFile(pView);
+        return lResult;
+    }
+    // the section handle stays with vm, an open view keeps the section alive on its own
+    cvm->PE.LoadStatus = vm->PE.LoadStatus;
+    cvm->PE.LoadStatus.Attached = FALSE;
+    cvm->PE.LoadStatus.Mapped = TRUE;
+    cvm->PE.LoadStatus.Tracked = FALSE;
+    // vm's relocations are for vm's base, and iat writes vm made since its section was created stayed private to vm
+    cvm->PE.LoadStatus.Relocated = FALSE;
+    if (bStale)
+        cvm->PE.LoadStatus.Imported = FALSE;
+    cvm->PE.pContext = vm->PE.pContext;
+    cvm->PE.hFile = NULL;
+    cvm->PE.hMapping = NULL;
     cvm->Blink = (void*)vm;
     cvm->Flink = vm->Flink;
+    if (vm->Flink != NULL)
+        ((VIRTUAL_MODULE*)vm->Flink)->Blink = (void*)cvm;
     vm->Flink = (void*)cvm;
     return LOGICAL_TRUE;
 }
 
 
 /// <summary>
-///	Changes a PE's page protections to allow for execution </summary>
+///	Appends a run to a plan, growing the last run instead if it's contiguous with the same protection </summary>
+static void PlAddProtectRun(INOUT PROTECT_PLAN* pp, IN const PTR Rva, IN const PTR cbSize, IN const DWORD dwProtect) {
+    PROTECT_RUN *pLast = pp->cRuns ? &pp->pRuns[pp->cRuns - 1] : NULL;
+
+    if (!cbSize)
+        return;
+    if (pLast != NULL && pLast->dwProtect == dwProtect && pLast->Rva + pLast->cbSize == Rva) {
+        pLast->cbSize += cbSize;
+        return;
+    }
+    pp->pRuns[pp->cRuns].Rva = Rva;
+    pp->pRuns[pp->cRuns].cbSize = cbSize;
+    pp->pRuns[pp->cRuns].dwProtect = dwProtect;
+    ++pp->cRuns;
+}
+
+/// <summary>
+///	Orders section headers by VirtualAddress </summary>
+static int PlCompareSectionRva(IN const void* pA, IN const void* pB) {
+    DWORD dwA = (*(const SECTION_HEADER* const*)pA)->VirtualAddress,
+          dwB = (*(const SECTION_HEADER* const*)pB)->VirtualAddress;
+
+    return dwA < dwB ? -1 : dwA > dwB;
+}
+
+/// <summary>
+///	Turns the section table into page aligned runs of identical protection, merging neighbours.
+/// Sections are planned in VirtualAddress order whatever order the table has. A page shared by
+/// sections with different protections gets the union of both (it can end up writable and executable) </summary>
+///
+/// <param name="vm">
+/// Pointer to loaded VIRTUAL_MODULE </param>
+/// <param name="pp">
+/// Pointer to PROTECT_PLAN to recieve runs, free with PlFreeProtectionPlan </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT error </returns>
+LOGICAL EXPORT LIBCALL PlPlanProtection(IN const VIRTUAL_MODULE* vm, OUT PROTECT_PLAN* pp) {
+    SYSTEM_INFO      si;
+    PROTECT_RUN     *pLast = NULL;
+    SECTION_HEADER **ppSorted = NULL;
+    PTR              Start = 0,
+                     End = 0,
+                     LastEnd = 0,
+                     SharedEnd = 0;
+    DWORD            dwProtect = 0,
+                     dwLastProtect = 0,
+                     dwUnion = 0;
+    WORD             wNumSections = vm->PE.pNtHdr->FileHeader.NumberOfSections > MAX_SECTIONS ? MAX_SECTIONS : vm->PE.pNtHdr->FileHeader.NumberOfSections;
+
+    memset(pp, 0, sizeof(*pp));
+    GetSystemInfo(&si);
+    // a shared range can split a run in three, so at most 3 runs per section + headers
+    pp->pRuns = malloc((3 * wNumSections + 1) * sizeof(*pp->pRuns));
+    if (pp->pRuns == NULL)
+        return LOGICAL_MAYBE;
+    if (wNumSections) {
+        ppSorted = malloc(wNumSections * sizeof(*ppSorted));
+        if (ppSorted == NULL) {
+            PlFreeProtectionPlan(pp);
+            return LOGICAL_MAYBE;
+        }
+        memcpy(ppSorted, vm->PE.ppSecHdr, wNumSections * sizeof(*ppSorted));
+        qsort(ppSorted, wNumSections, sizeof(*ppSorted), PlCompareSectionRva);
+    }
+    PlAddProtectRun(pp, 0, PlAlignUp(vm->PE.pNtHdr->OptionalHeader.SizeOfHeaders, si.dwPageSize), PAGE_READONLY);
+    for (register size_t i = 0; i < wNumSections; ++i) {
+        Start = PlAlignDown(ppSorted[i]->VirtualAddress, si.dwPageSize);
+        End = ppSorted[i]->VirtualAddress + PlAlignUp(ppSorted[i]->Misc.VirtualSize ? ppSorted[i]->Misc.VirtualSize : ppSorted[i]->SizeOfRawData,
+                                                      vm->PE.pNtHdr->OptionalHeader.SectionAlignment);
+        End = PlAlignUp(End, si.dwPageSize);
+        dwProtect = PlSectionToPageProtection(ppSorted[i]->Characteristics);
+        pLast = pp->cRuns ? &pp->pRuns[pp->cRuns - 1] : NULL;
+        // sorted, so only the tail of the previous run can be shared (more than a page if sections overlap)
+        if (pLast != NULL && Start < pLast->Rva + pLast->cbSize) {
+            LastEnd = pLast->Rva + pLast->cbSize;
+            SharedEnd = End < LastEnd ? End : LastEnd;
+            dwLastProtect = pLast->dwProtect;
+            if (dwLastProtect != dwProtect && SharedEnd > Start) {
+                dwUnion = PlSectionToPageProtection(PlPageToSectionProtection(dwLastProtect) | PlPageToSectionProtection(dwProtect));
+                dmsg(TEXT("\nPages %08lx-%08lx are shared by sections with protection %08lx and %08lx, using %08lx"),
+                     (unsigned long)Start, (unsigned long)SharedEnd, (unsigned long)dwLastProtect, (unsigned long)dwProtect, (unsigned long)dwUnion);
+                if (Start > pLast->Rva) {
+                    pLast->cbSize = Start - pLast->Rva;
+                    PlAddProtectRun(pp, Start, SharedEnd - Start, dwUnion);
+                } else {
+                    pLast->cbSize = SharedEnd - pLast->Rva;
+                    pLast->dwProtect = dwUnion;
+                }
+                // rest of the previous run is only the previous section's
+                PlAddProtectRun(pp, SharedEnd, LastEnd - SharedEnd, dwLastProtect);
+            }
+            Start = LastEnd;
+        }
+        if (End > Start)
+            PlAddProtectRun(pp, Start, End - Start, dwProtect);
+    }
+    if (ppSorted != NULL)
+        free(ppSorted);
+    pp->cSaved = wNumSections + 1 > pp->cRuns ? wNumSections + 1 - pp->cRuns : 0;
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Frees runs allocated by PlPlanProtection </summary>
+///
+/// <param name="pp">
+/// Pointer to PROTECT_PLAN </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE if nothing was planned, *pp is zeroed </returns>
+LOGICAL EXPORT LIBCALL PlFreeProtectionPlan(INOUT PROTECT_PLAN* pp) {
+    if (pp->pRuns == NULL)
+        return LOGICAL_FALSE;
+    free(pp->pRuns);
+    memset(pp, 0, sizeof(*pp));
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Changes a PE's page protections to allow for execution, using one call per run of PlPlanProtection </summary>
 ///
 /// <param name="vm">
 /// Pointer to loaded VIRTUAL_MODULE </param>
@@ -271,23 +600,27 @@ LOGICAL EXPORT LIBCALL PlCopyImageEx(IN VIRTUAL_MODULE* vm, IN const void* pBuff
 /// <returns>
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT error </returns>
 LOGICAL EXPORT LIBCALL PlProtectImage(INOUT VIRTUAL_MODULE* vm) {
+    PROTECT_PLAN pp;
     DWORD        dwProtect = 0;
-    unsigned int i;
+    LOGICAL      lResult = LOGICAL_FALSE;
 
-    if (!VirtualProtect(vm->PE.pDosHdr, vm->PE.pNtHdr->OptionalHeader.SizeOfHeaders, PAGE_READONLY, &dwProtect))
-        return LOGICAL_FALSE;
-    for (i = 0; i < vm->PE.pNtHdr->FileHeader.NumberOfSections; ++i) {
-        dwProtect = PlSectionToPageProtection(vm->PE.ppSecHdr[i]->Characteristics);
-        // virtualsize will be rounded up to page size, although we could align to SectionAlignment on our own
-        if (!VirtualProtect((LPVOID)((PTR)vm->pBaseAddr + vm->PE.ppSecHdr[i]->VirtualAddress), vm->PE.ppSecHdr[i]->Misc.VirtualSize, dwProtect, &dwProtect))
+    lResult = PlPlanProtection(vm, &pp);
+    if (!LOGICAL_SUCCESS(lResult))
+        return lResult;
+    for (register size_t i = 0; i < pp.cRuns; ++i) {
+        if (!VirtualProtect((LPVOID)((PTR)vm->pBaseAddr + pp.pRuns[i].Rva), pp.pRuns[i].cbSize, pp.pRuns[i].dwProtect, &dwProtect)) {
+            PlFreeProtectionPlan(&pp);
             return LOGICAL_FALSE;
+        }
     }
+    dmsg(TEXT("\nProtected PE image at 0x%p with %u calls (%u saved)"), vm->pBaseAddr, (unsigned int)pp.cRuns, (unsigned int)pp.cSaved);
+    PlFreeProtectionPlan(&pp);
     vm->PE.LoadStatus.Protected = TRUE;
     return LOGICAL_TRUE;
 }
 
 /// <summary>
-///	Returns a PE to read & write pages for editing </summary>
+///	Returns a PE to read & write pages for editing, the whole image is one allocation so one call does it </summary>
 ///
 /// <param name="vm">
 /// Pointer to loaded VIRTUAL_MODULE </param>
@@ -295,16 +628,13 @@ LOGICAL EXPORT LIBCALL PlProtectImage(INOUT VIRTUAL_MODULE* vm) {
 /// <returns>
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT error </returns>
 LOGICAL EXPORT LIBCALL PlUnprotectImage(INOUT VIRTUAL_MODULE* vm) {
-    DWORD        dwProtect = 0;
-    unsigned int i;
+    DWORD dwProtect = 0;
+    PTR   MaxRva = 0;
 
-    if (!VirtualProtect(vm->PE.pDosHdr, vm->PE.pNtHdr->OptionalHeader.SizeOfHeaders, PAGE_READWRITE, &dwProtect))
+    if (!LOGICAL_SUCCESS(PlMaxRva(&vm->PE, &MaxRva)))
+        return LOGICAL_FALSE;
+    if (!VirtualProtect(vm->pBaseAddr, MaxRva, PAGE_READWRITE, &dwProtect))
         return LOGICAL_FALSE;
-    for (i = 0; i < vm->PE.pNtHdr->FileHeader.NumberOfSections; ++i) {
-        // virtualsize will be rounded up to page size, although we could align to SectionAlignment on our own
-        if (!VirtualProtect((LPVOID)((PTR)vm->pBaseAddr + vm->PE.ppSecHdr[i]->VirtualAddress), vm->PE.ppSecHdr[i]->Misc.VirtualSize, PAGE_READWRITE, &dwProtect))
-            return LOGICAL_FALSE;
-    }
     vm->PE.LoadStatus.Protected = FALSE;
     return LOGICAL_TRUE;
 }
@@ -320,11 +650,14 @@ LOGICAL EXPORT LIBCALL PlUnprotectImage(INOUT VIRTUAL_MODULE* vm) {
 LOGICAL EXPORT LIBCALL PlFreeImage(INOUT VIRTUAL_MODULE* vm) {
     VIRTUAL_MODULE *vmNext = NULL,
                    *vmPrev = NULL;
+    PEEL_CONTEXT   *ctx = vm->PE.pContext;
 
     if (!LOGICAL_SUCCESS(PlFreeFile(&vm->PE)))
         return LOGICAL_FALSE;
 
     dmsg(TEXT("\nUnlinking PE Image at %p"), vm->pBaseAddr);
+    if (ctx != NULL)
+        PlUnregisterImage(ctx, vm);
     vmPrev = (VIRTUAL_MODULE*)vm->Blink;
     vmNext = (VIRTUAL_MODULE*)vm->Flink;
     if (vmPrev != NULL)
@@ -345,7 +678,120 @@ LOGICAL EXPORT LIBCALL PlFreeImage(INOUT VIRTUAL_MODULE* vm) {
 /// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error, *vm is zeroed </returns>
 LOGICAL EXPORT LIBCALL PlReleaseImage(INOUT VIRTUAL_MODULE* vm) {
     if (vm->PE.LoadStatus.Attached == TRUE)
-        return PlFreeImage(vm);
-    else
         return PlDetachImage(vm);
+    else
+        return PlFreeImage(vm);
+}
+
+/// <summary>
+///	Records the current state of an image so PlRestoreImage can reset it later. Images allocated with
+/// MEM_WRITE_WATCH (WRITE_WATCH_IMAGES) report their written pages, anything else is compared page by page </summary>
+///
+/// <param name="vm">
+/// Loaded VIRTUAL_MODULE struct, must stay loaded at the same address while the snapshot is used </param>
+/// <param name="snap">
+/// Pointer to IMAGE_SNAPSHOT struct to recieve baseline </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlSnapshotImage(IN VIRTUAL_MODULE* vm, OUT IMAGE_SNAPSHOT* snap) {
+    SYSTEM_INFO si;
+    PTR         MaxRva = 0;
+
+    memset(snap, 0, sizeof(*snap));
+    if (!LOGICAL_SUCCESS(PlMaxRva(&vm->PE, &MaxRva)))
+        return LOGICAL_FALSE;
+    GetSystemInfo(&si);
+    snap->vm = vm;
+    snap->cbImage = MaxRva;
+    snap->cPages = (MaxRva + si.dwPageSize - 1) / si.dwPageSize;
+    snap->LoadStatus = vm->PE.LoadStatus;
+    snap->pBaseline = VirtualAlloc(NULL, MaxRva, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (snap->pBaseline == NULL)
+        return LOGICAL_MAYBE;
+    memmove(snap->pBaseline, vm->pBaseAddr, MaxRva);
+    // fails unless the allocation was made with MEM_WRITE_WATCH
+    if (!ResetWriteWatch(vm->pBaseAddr, MaxRva)) {
+        snap->ppDirty = malloc(snap->cPages * sizeof(*snap->ppDirty));
+        if (snap->ppDirty == NULL) {
+            VirtualFree(snap->pBaseline, 0, MEM_RELEASE);
+            memset(snap, 0, sizeof(*snap));
+            return LOGICAL_MAYBE;
+        }
+        snap->bWriteWatch = TRUE;
+    }
+    dmsg(TEXT("\nSnapshot of PE image at 0x%p (%s)"), vm->pBaseAddr, snap->bWriteWatch ? TEXT("write watch") : TEXT("compare"));
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Resets an image to the state it was in when the snapshot was taken, only copying pages that changed.
+/// Lists enumerated since the snapshot are not touched </summary>
+///
+/// <param name="snap">
+/// Snapshot from PlSnapshotImage, cRestored recieves number of pages copied </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error </returns>
+LOGICAL EXPORT LIBCALL PlRestoreImage(INOUT IMAGE_SNAPSHOT* snap) {
+    VIRTUAL_MODULE *vm = snap->vm;
+    SYSTEM_INFO     si;
+    ULONG_PTR       cDirty = 0;
+    ULONG           cbGranularity = 0;
+    size_t          cbPage = 0,
+                    cbCopy = 0,
+                    Offset = 0;
+    BOOL            bProtected = vm->PE.LoadStatus.Protected;
+
+    if (snap->pBaseline == NULL)
+        return LOGICAL_FALSE;
+    GetSystemInfo(&si);
+    cbPage = si.dwPageSize;
+    if (bProtected && !LOGICAL_SUCCESS(PlUnprotectImage(vm)))
+        return LOGICAL_MAYBE;
+    snap->cRestored = 0;
+    cDirty = snap->cPages;
+    if (snap->bWriteWatch
+     && !GetWriteWatch(WRITE_WATCH_FLAG_RESET, vm->pBaseAddr, snap->cbImage, snap->ppDirty, &cDirty, &cbGranularity)) {
+        for (register size_t i = 0; i < cDirty; ++i) {
+            Offset = (PTR)snap->ppDirty[i] - (PTR)vm->pBaseAddr;
+            cbCopy = Offset + cbGranularity > snap->cbImage ? snap->cbImage - Offset : cbGranularity;
+            memmove(snap->ppDirty[i], (void*)((PTR)snap->pBaseline + Offset), cbCopy);
+        }
+        snap->cRestored = cDirty;
+        // our own copies count as writes
+        ResetWriteWatch(vm->pBaseAddr, snap->cbImage);
+    } else {
+        for (Offset = 0; Offset < snap->cbImage; Offset += cbPage) {
+            cbCopy = Offset + cbPage > snap->cbImage ? snap->cbImage - Offset : cbPage;
+            if (memcmp((void*)((PTR)vm->pBaseAddr + Offset), (void*)((PTR)snap->pBaseline + Offset), cbCopy)) {
+                memmove((void*)((PTR)vm->pBaseAddr + Offset), (void*)((PTR)snap->pBaseline + Offset), cbCopy);
+                ++snap->cRestored;
+            }
+        }
+    }
+    vm->PE.LoadStatus = snap->LoadStatus;
+    vm->PE.LoadStatus.Protected = FALSE;
+    if (bProtected && !LOGICAL_SUCCESS(PlProtectImage(vm)))
+        return LOGICAL_MAYBE;
+    dmsg(TEXT("\nRestored %u pages of PE image at 0x%p"), (unsigned int)snap->cRestored, vm->pBaseAddr);
+    return LOGICAL_TRUE;
+}
+
+/// <summary>
+///	Frees a snapshot, the image itself is left alone </summary>
+///
+/// <param name="snap">
+/// Snapshot from PlSnapshotImage </param>
+///
+/// <returns>
+/// LOGICAL_TRUE on success, LOGICAL_FALSE on PE related error, LOGICAL_MAYBE on CRT/memory error, *snap is zeroed </returns>
+LOGICAL EXPORT LIBCALL PlFreeSnapshot(INOUT IMAGE_SNAPSHOT* snap) {
+    if (snap->pBaseline == NULL)
+        return LOGICAL_FALSE;
+    VirtualFree(snap->pBaseline, 0, MEM_RELEASE);
+    if (snap->ppDirty != NULL)
+        free(snap->ppDirty);
+    memset(snap, 0, sizeof(*snap));
+    return LOGICAL_TRUE;
 }
@@ -24,6 +24,12 @@
 
 #include "peel.h"
 
+#if WRITE_WATCH_IMAGES
+#   define IMAGE_ALLOC_TYPE (MEM_RESERVE | MEM_COMMIT | MEM_WRITE_WATCH)
+#else
+#   define IMAGE_ALLOC_TYPE (MEM_RESERVE | MEM_COMMIT)
+#endif
+
 #pragma region Virtual Image functions
     LOGICAL EXPORT LIBCALL PlAttachImage(IN const void* const pModuleBase, OUT VIRTUAL_MODULE* vm);
     LOGICAL EXPORT LIBCALL PlDetachImage(INOUT VIRTUAL_MODULE* vm);
@@ -34,6 +40,16 @@
     LOGICAL EXPORT LIBCALL PlCopyImage(IN VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cvm);
     LOGICAL EXPORT LIBCALL PlCopyImageEx(IN VIRTUAL_MODULE* vm, IN const void* pBuffer, OUT VIRTUAL_MODULE* cvm);
 
+    LOGICAL EXPORT LIBCALL PlShareImage(INOUT VIRTUAL_MODULE* vm);
+    LOGICAL EXPORT LIBCALL PlCopyImageCow(INOUT VIRTUAL_MODULE* vm, OUT VIRTUAL_MODULE* cvm);
+
+    LOGICAL EXPORT LIBCALL PlSnapshotImage(IN VIRTUAL_MODULE* vm, OUT IMAGE_SNAPSHOT* snap);
+    LOGICAL EXPORT LIBCALL PlRestoreImage(INOUT IMAGE_SNAPSHOT* snap);
+    LOGICAL EXPORT LIBCALL PlFreeSnapshot(INOUT IMAGE_SNAPSHOT* snap);
+
+    LOGICAL EXPORT LIBCALL PlPlanProtection(IN const VIRTUAL_MODULE* vm, OUT PROTECT_PLAN* pp);
+    LOGICAL EXPORT LIBCALL PlFreeProtectionPlan(INOUT PROTECT_PLAN* pp);
+
     LOGICAL EXPORT LIBCALL PlProtectImage(INOUT VIRTUAL_MODULE* vm);
     LOGICAL EXPORT LIBCALL PlUnprotectImage(INOUT VIRTUAL_MODULE* vm);
 